@@ -0,0 +1,118 @@
+// AlphaMask.cpp - downsampled CPU copies of texture coverage, for hit tests without z-buffer reads
+
+#include <glad.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <unordered_map>
+#include "AlphaMask.h"
+#include "Atlas.h"
+#include "GLState.h"
+
+namespace {
+
+std::unordered_map<GLuint, AlphaMask> masks;
+
+const unsigned char threshold = 5; // sprite shaders discard alpha < .02
+
+} // end namespace
+
+void AlphaMask::Build(unsigned char *pixels, int w, int h, int nChannels, int maxRes) {
+	int size = w > h? w : h, block = size > maxRes? (size+maxRes-1)/maxRes : 1;
+	width = (w+block-1)/block;
+	height = (h+block-1)/block;
+	bits.assign((width*height+31)/32, 0);
+	int channel = nChannels == 4? 3 : nChannels == 2? 1 : 0;
+	for (int j = 0; j < h; j++) {
+		unsigned char *p = pixels+j*w*nChannels+channel;
+		for (int i = 0; i < w; i++, p += nChannels)
+			if (nChannels == 3 || *p >= threshold) {
+				int k = (j/block)*width+i/block;
+				bits[k/32] |= 1u << (k%32);
+			}
+	}
+}
+
+bool AlphaMask::Covered(vec2 uv) {
+	if (!width || !height)
+		return true;
+	float u = uv.x-floor(uv.x), v = uv.y-floor(uv.y);
+	int i = (int) (u*width), j = (int) (v*height);
+	i = i < width? i : width-1;
+	j = j < height? j : height-1;
+	int k = j*width+i;
+	return (bits[k/32] >> (k%32)) & 1;
+}
+
+void BuildAlphaMask(GLuint textureName, unsigned char *pixels, int width, int height, int nChannels) {
+	masks[textureName].Build(pixels, width, height, nChannels);
+}
+
+void BuildAlphaMask(GLuint textureName) {
+	// a synchronous GPU readback: a last resort, for textures loaded without a mask
+	if (ResolveTexture(textureName).texture != textureName)
+		return;							// reserved name: no storage of its own to read
+	GLint width = 0, height = 0, redSize = 0, greenSize = 0, alphaSize = 0;
+	BindTexture(GL_TEXTURE_2D, textureName);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_RED_SIZE, &redSize);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_GREEN_SIZE, &greenSize);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_ALPHA_SIZE, &alphaSize);
+	AlphaMask &m = masks[textureName];
+	if (width > 0 && height > 0) {
+		// as with LoadTexture, 4 channels if alpha, 1 if red only, else 3
+		int nChannels = alphaSize? 4 : redSize && !greenSize? 1 : 3;
+		vector<unsigned char> pixels(width*height*nChannels);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glGetTexImage(GL_TEXTURE_2D, 0, nChannels == 4? GL_RGBA : nChannels == 1? GL_RED : GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+		m.Build(pixels.data(), width, height, nChannels);
+	}
+	BindTexture(GL_TEXTURE_2D, 0);
+}
+
+void SetAlphaMask(GLuint textureName, const AlphaMask &mask) {
+	masks[textureName] = mask;
+}
+
+AlphaMask *GetAlphaMask(GLuint textureName) {
+	auto m = masks.find(textureName);
+	if (m != masks.end())
+		return &m->second;
+	// atlas regions, array layers and loaded images get masks when made, so a reserved
+	// name without one is still loading (a placeholder): treat as fully covered
+	if (ResolveTexture(textureName).texture != textureName)
+		return NULL;
+	printf("GetAlphaMask: no mask for texture %u, reading it back\n", textureName);
+	BuildAlphaMask(textureName);
+	return &masks[textureName];
+}
+
+void ReleaseAlphaMask(GLuint textureName) {
+	masks.erase(textureName);
+}
+
+AlphaMask *SpriteMask(Sprite &s) {
+	// as in the sprite pixel shader: texture alpha if 4 channels, else matte if any, else opaque
+	GLuint textureName = s.nFrames? s.images[s.frame].textureName : s.textureName;
+	int nChannels = s.nFrames? s.images[s.frame].nChannels : s.nTexChannels;
+	if (nChannels != 4)
+		return s.matName? GetAlphaMask(s.matName) : NULL;
+	return textureName? GetAlphaMask(textureName) : NULL;
+}
+
+bool SpriteHit(Sprite &s, vec2 ndc) {
+	// ptTransform is affine in x, y: invert its upper 2x2 and translation to find quad coordinates
+	mat4 &m = s.ptTransform;
+	float a = m[0][0], b = m[0][1], c = m[1][0], d = m[1][1], det = a*d-b*c;
+	if (fabs(det) < FLT_MIN)
+		return false;
+	float x = ndc.x-m[0][3], y = ndc.y-m[1][3];
+	vec2 q((d*x-b*y)/det, (a*y-c*x)/det);
+	if (q.x < -1 || q.x > 1 || q.y < -1 || q.y > 1)
+		return false;
+	// as in the sprite vertex shader
+	vec4 uv = s.uvTransform*vec4((q.x+1)/2, (q.y+1)/2, 0, 1);
+	AlphaMask *mask = SpriteMask(s);
+	return !mask || mask->Covered(vec2(uv.x, uv.y));
+}
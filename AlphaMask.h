@@ -0,0 +1,49 @@
+// AlphaMask.h - downsampled CPU copies of texture coverage, for hit tests without z-buffer reads
+
+#ifndef ALPHA_MASK_HDR
+#define ALPHA_MASK_HDR
+
+#include <glad.h>
+#include <vector>
+#include "Sprite.h"
+#include "VecMat.h"
+
+using std::vector;
+
+// a mask bit is set if any texel in its block is drawn (alpha above the sprite
+// shader's discard threshold); masks are kept per texture name, so sprites
+// sharing a texture (via TextureCache) share a mask
+
+class AlphaMask {
+public:
+	int width = 0, height = 0;
+	vector<unsigned int> bits;
+	void Build(unsigned char *pixels, int w, int h, int nChannels, int maxRes = 128);
+		// coverage from alpha if 4 (or 2) channels, red if 1, else fully covered
+	bool Covered(vec2 uv);
+		// uv wraps, as with GL_REPEAT
+};
+
+void BuildAlphaMask(GLuint textureName, unsigned char *pixels, int width, int height, int nChannels);
+	// called when the texture is loaded from pixels
+
+void BuildAlphaMask(GLuint textureName);
+	// read the texture back from the GPU (once, at load) when the pixels are gone;
+	// ignored for reserved names (see ReserveTextureName in Atlas.h)
+
+void SetAlphaMask(GLuint textureName, const AlphaMask &mask);
+	// a mask built earlier (eg, stored in a texture pack)
+
+AlphaMask *GetAlphaMask(GLuint textureName);
+	// NULL (fully covered) for a reserved name without a mask (eg, still loading);
+	// otherwise read back (logged, as it stalls) on first request if not already built
+
+void ReleaseAlphaMask(GLuint textureName);
+
+AlphaMask *SpriteMask(Sprite &s);
+	// mask of s's current image (or matte), NULL if fully covered
+
+bool SpriteHit(Sprite &s, vec2 ndc);
+	// is ndc within s's quad and covered by the mask of s's current image?
+
+#endif
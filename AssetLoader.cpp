@@ -0,0 +1,228 @@
+// AssetLoader.cpp - decode images on worker threads, stream them to GL a little per frame
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <unordered_map>
+#include "AssetLoader.h"
+#include "GLState.h"
+#include "STB_Image.h"
+
+namespace {
+
+const size_t bandSize = 1 << 18;		// bytes per pixel-unpack upload
+
+struct Request {
+	int id = 0;
+	vector<string> filenames;
+	bool array = false, mipmap = true;
+	AssetCallback done;
+	std::atomic<bool> cancelled{false};
+	// set by a worker
+	vector<unsigned char> pixels;
+	int width = 0, height = 0, nChannels = 0;
+	bool failed = false;
+	// set by UpdateAssets
+	GLuint texture = 0;
+	int row = 0;						// next row to upload, counting through all frames
+};
+
+typedef std::shared_ptr<Request> RequestPtr;
+
+struct Workers {
+	vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<RequestPtr> toDecode;	// guarded by mutex
+	std::deque<RequestPtr> decoded;		// guarded by mutex
+	bool quit = false;
+	~Workers() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+		for (std::thread &t : threads)
+			t.join();
+	}
+} workers;
+
+// GL thread only
+std::unordered_map<int, RequestPtr> live;	// requested, callback not yet run
+RequestPtr uploading;
+GLuint pbo = 0;
+int nextId = 1;
+
+void Decode(Request &r) {
+	// stb's vertical flip is a global setting; every caller in this tree sets it true
+	for (string &f : r.filenames) {
+		int w, h, n;
+		unsigned char *data = stbi_load(f.c_str(), &w, &h, &n, 0);
+		bool same = r.pixels.empty() || (w == r.width && h == r.height && n == r.nChannels);
+		if (data && same)
+			r.pixels.insert(r.pixels.end(), data, data+w*h*n);
+		if (data)
+			stbi_image_free(data);
+		if (!data || !same) {
+			printf("RequestAsset: can't read %s%s\n", f.c_str(), data? " (frames differ)" : "");
+			r.failed = true;
+			r.pixels.clear();
+			return;
+		}
+		r.width = w; r.height = h; r.nChannels = n;
+		if (!r.array)
+			break;
+	}
+}
+
+void Work() {
+	for (;;) {
+		RequestPtr r;
+		{
+			std::unique_lock<std::mutex> lock(workers.mutex);
+			workers.wake.wait(lock, [] { return workers.quit || !workers.toDecode.empty(); });
+			if (workers.quit)
+				return;
+			r = workers.toDecode.front();
+			workers.toDecode.pop_front();
+		}
+		if (!r->cancelled)
+			Decode(*r);
+		std::lock_guard<std::mutex> lock(workers.mutex);
+		workers.decoded.push_back(r);
+	}
+}
+
+GLenum Format(int nChannels) {
+	return nChannels == 4? GL_RGBA : nChannels == 3? GL_RGB : nChannels == 2? GL_RG : GL_RED;
+}
+
+bool UploadBand(Request &r) {
+	// copy rows (within one frame) through the unpack buffer; return true when all are sent
+	GLenum target = r.array? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D, format = Format(r.nChannels);
+	int nFrames = r.array? (int) r.filenames.size() : 1, rowSize = r.width*r.nChannels;
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (!r.texture) {
+		glGenTextures(1, &r.texture);
+		BindTexture(target, r.texture);
+		if (r.array)
+			glTexImage3D(target, 0, format, r.width, r.height, nFrames, 0, format, GL_UNSIGNED_BYTE, NULL);
+		else
+			glTexImage2D(target, 0, format, r.width, r.height, 0, format, GL_UNSIGNED_BYTE, NULL);
+	}
+	int frame = r.row/r.height, y = r.row%r.height;
+	int nRows = std::min(r.height-y, std::max(1, (int) (bandSize/rowSize)));
+	size_t size = (size_t) nRows*rowSize;
+	if (!pbo)
+		glGenBuffers(1, &pbo);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	// orphan the previous band's storage, so mapping needn't wait for its transfer
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+	void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (dst) {
+		memcpy(dst, r.pixels.data()+(size_t) r.row*rowSize, size);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+	BindTexture(target, r.texture);
+	if (r.array)
+		glTexSubImage3D(target, 0, 0, y, frame, r.width, nRows, 1, format, GL_UNSIGNED_BYTE, (void *) 0);
+	else
+		glTexSubImage2D(target, 0, 0, y, r.width, nRows, format, GL_UNSIGNED_BYTE, (void *) 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	r.row += nRows;
+	if (r.row < nFrames*r.height) {
+		BindTexture(target, 0);
+		return false;
+	}
+	// as LoadTexture
+	if (r.mipmap) {
+		glGenerateMipmap(target);
+		glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	}
+	else
+		glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	BindTexture(target, 0);
+	return true;
+}
+
+void Finish(Request &r) {
+	LoadedAsset a;
+	if (!r.failed) {
+		a.texture = r.texture;
+		a.target = r.array? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+		a.width = r.width;
+		a.height = r.height;
+		a.nChannels = r.nChannels;
+		a.nFrames = r.array? (int) r.filenames.size() : 1;
+		a.pixels = r.pixels.data();
+	}
+	live.erase(r.id);
+	r.done(a);
+}
+
+} // end namespace
+
+int RequestAsset(vector<string> &filenames, bool array, bool mipmap, AssetCallback done) {
+	if (workers.threads.empty()) {
+		// leave a core for the GL thread
+		int n = std::min(4, std::max(1, (int) std::thread::hardware_concurrency()-1));
+		for (int i = 0; i < n; i++)
+			workers.threads.emplace_back(Work);
+	}
+	RequestPtr r = std::make_shared<Request>();
+	r->id = nextId++;
+	r->filenames = filenames;
+	r->array = array;
+	r->mipmap = mipmap;
+	r->done = done;
+	live[r->id] = r;
+	stbi_set_flip_vertically_on_load(true);
+	{
+		std::lock_guard<std::mutex> lock(workers.mutex);
+		workers.toDecode.push_back(r);
+	}
+	workers.wake.notify_one();
+	return r->id;
+}
+
+void CancelAsset(int id) {
+	auto i = live.find(id);
+	if (i == live.end())
+		return;
+	i->second->cancelled = true;		// dropped by a worker or UpdateAssets
+	live.erase(i);
+}
+
+void UpdateAssets(float budgetMs) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	do {
+		if (!uploading) {
+			std::lock_guard<std::mutex> lock(workers.mutex);
+			if (workers.decoded.empty())
+				return;
+			uploading = workers.decoded.front();
+			workers.decoded.pop_front();
+		}
+		Request &r = *uploading;
+		if (r.cancelled) {
+			if (r.texture)
+				DeleteTextures(1, &r.texture);
+			uploading = NULL;
+		}
+		else if (r.failed || UploadBand(r)) {
+			RequestPtr done = uploading;
+			uploading = NULL;
+			Finish(*done);
+		}
+	} while (std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now()-start).count() < budgetMs);
+}
+
+int NPendingAssets() { return (int) live.size(); }
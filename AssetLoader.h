@@ -0,0 +1,40 @@
+// AssetLoader.h - decode images on worker threads, stream them to GL a little per frame
+
+#ifndef ASSET_LOADER_HDR
+#define ASSET_LOADER_HDR
+
+#include <glad.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+// workers read and decode the files of a request; UpdateAssets, called once per
+// frame on the GL thread, copies decoded rows into textures through a pixel-unpack
+// buffer, band by band, until its time budget is spent, so no frame stalls on a
+// large image; when a texture is complete its callback runs, on the GL thread
+
+struct LoadedAsset {
+	GLuint texture = 0;				// 0 if a file could not be read
+	GLenum target = GL_TEXTURE_2D;	// GL_TEXTURE_2D_ARRAY if requested as an array
+	int width = 0, height = 0, nChannels = 0, nFrames = 0;
+	unsigned char *pixels = NULL;	// frames stored consecutively; valid only during the callback
+};
+
+typedef std::function<void(LoadedAsset &a)> AssetCallback;
+
+int RequestAsset(vector<string> &filenames, bool array, bool mipmap, AssetCallback done);
+	// if array, make one texture array whose layers are the files (which must agree
+	// in size and #channels), else one texture of filenames[0]; return request id
+
+void CancelAsset(int id);
+	// the callback won't run, and any texture made for the request is deleted
+
+void UpdateAssets(float budgetMs = 2);
+	// upload decoded images, run callbacks; call once per frame, on the GL thread
+
+int NPendingAssets();
+
+#endif
@@ -0,0 +1,219 @@
+// Atlas.cpp - pack sprite images into a few large textures
+
+#include <glad.h>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <unordered_map>
+#include "AlphaMask.h"
+#include "Atlas.h"
+#include "GLState.h"
+#include "IO.h"
+#include "STB_Image.h"
+#include "TextureCache.h"
+#include "TexturePack.h"
+
+namespace {
+
+std::unordered_map<GLuint, TextureBinding> bindings;	// by reserved texture name
+vector<GLuint> pages, regions;							// regions are reserved names
+
+const int padding = 4;	// replicated edge texels around each image, for filtering and 2 mip levels
+
+// skyline bottom-left packing: the skyline is the top edge of the packed images,
+// kept as horizontal segments; each image goes where it rests lowest
+
+struct Segment { int x, y, w; };
+
+class Skyline {
+public:
+	Skyline(int size) : size(size) { segments.push_back({0, 0, size}); }
+	bool Place(int w, int h, int &x, int &y) {
+		int best = -1, bestY = size, bestW = size+1;
+		for (int i = 0; i < (int) segments.size(); i++) {
+			int top = Fit(i, w);
+			if (top < 0 || top+h > size)
+				continue;
+			if (top < bestY || (top == bestY && segments[i].w < bestW)) {
+				best = i;
+				bestY = top;
+				bestW = segments[i].w;
+			}
+		}
+		if (best < 0)
+			return false;
+		x = segments[best].x;
+		y = bestY;
+		Add(best, x, y+h, w);
+		return true;
+	}
+private:
+	int size;
+	vector<Segment> segments;
+	int Fit(int i, int w) {
+		// height at which an image of width w rests if its left edge is segment i's
+		int top = 0;
+		if (segments[i].x+w > size)
+			return -1;
+		for (int covered = 0; covered < w; covered += segments[i++].w)
+			top = std::max(top, segments[i].y);
+		return top;
+	}
+	void Add(int i, int x, int y, int w) {
+		segments.insert(segments.begin()+i, {x, y, w});
+		// trim or remove segments now under the new one
+		for (int k = i+1; k < (int) segments.size(); k++) {
+			Segment &s = segments[k];
+			int shrink = x+w-s.x;
+			if (shrink <= 0)
+				break;
+			s.x += shrink;
+			s.w -= shrink;
+			if (s.w > 0)
+				break;
+			segments.erase(segments.begin()+k--);
+		}
+		// merge neighbors of equal height
+		for (int k = 0; k+1 < (int) segments.size(); k++)
+			if (segments[k].y == segments[k+1].y) {
+				segments[k].w += segments[k+1].w;
+				segments.erase(segments.begin()+k+1);
+				k--;
+			}
+	}
+};
+
+struct Image {
+	string filename;
+	unsigned char *pixels = NULL;
+	bool packed = false;				// pixels are in the texture pack, else from stbi_load
+	int width = 0, height = 0;
+	int page = -1, x = 0, y = 0;
+};
+
+void Blit(vector<unsigned char> &page, int pageSize, Image &im) {
+	// copy image, replicating its edges into the padding
+	for (int j = -padding; j < im.height+padding; j++) {
+		int sj = std::min(std::max(j, 0), im.height-1);
+		unsigned char *dst = &page[4*((im.y+j)*pageSize+im.x-padding)];
+		for (int i = -padding; i < im.width+padding; i++, dst += 4) {
+			int si = std::min(std::max(i, 0), im.width-1);
+			memcpy(dst, im.pixels+4*(sj*im.width+si), 4);
+		}
+	}
+}
+
+} // end namespace
+
+int BuildAtlas(vector<string> &imageFiles, int pageSize, int maxImageSize) {
+	// an image must fit a page with its padding, else no new page would take it
+	maxImageSize = std::min(maxImageSize, pageSize-2*padding);
+	vector<Image> images;
+	stbi_set_flip_vertically_on_load(true);
+	for (string &f : imageFiles) {
+		Image im;
+		int nChannels = 0;
+		im.filename = f;
+		PackedImage p;
+		if (FindPackedImage(f.c_str(), p) && p.nStored == 4 && !p.format) {
+			im.pixels = (unsigned char *) p.pixels;
+			im.packed = true;
+			im.width = p.width;
+			im.height = p.height;
+			nChannels = p.nChannels;
+		}
+		else
+			im.pixels = stbi_load(f.c_str(), &im.width, &im.height, &nChannels, 0);
+		if (!im.pixels)
+			printf("BuildAtlas: can't open %s (%s)\n", f.c_str(), stbi_failure_reason());
+		else if (nChannels != 4 || im.width > maxImageSize || im.height > maxImageSize) {
+			if (!im.packed)
+				stbi_image_free(im.pixels);
+		}
+		else
+			images.push_back(im);
+	}
+	// tallest first packs tightest
+	std::sort(images.begin(), images.end(), [](const Image &a, const Image &b) { return a.height > b.height; });
+	vector<Skyline> skylines;
+	for (Image &im : images) {
+		int w = im.width+2*padding, h = im.height+2*padding;
+		for (int p = 0; im.page < 0; p++) {
+			if (p == (int) skylines.size())
+				skylines.push_back(Skyline(pageSize));
+			if (skylines[p].Place(w, h, im.x, im.y)) {
+				im.page = p;
+				im.x += padding;
+				im.y += padding;
+			}
+		}
+	}
+	int nPages = (int) skylines.size();
+	for (int p = 0; p < nPages; p++) {
+		vector<unsigned char> pixels(4*pageSize*pageSize, 0);
+		for (Image &im : images)
+			if (im.page == p)
+				Blit(pixels, pageSize, im);
+		GLuint page = LoadTexture(pixels.data(), pageSize, pageSize, 4, false, true);
+		BindTexture(GL_TEXTURE_2D, page);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 2); // padding/4 texels at level 2
+		BindTexture(GL_TEXTURE_2D, 0);
+		pages.push_back(page);
+		for (Image &im : images)
+			if (im.page == p) {
+				TextureBinding b;
+				float s = (float) pageSize;
+				b.texture = page;
+				b.rect = vec4(im.x/s, im.y/s, im.width/s, im.height/s);
+				GLuint name = ReserveTextureName(b);
+				regions.push_back(name);
+				BuildAlphaMask(name, im.pixels, im.width, im.height, 4);
+				CacheTextureName(im.filename.c_str(), name, 4, im.width, im.height);
+			}
+	}
+	for (Image &im : images)
+		if (!im.packed)
+			stbi_image_free(im.pixels);
+	return nPages;
+}
+
+bool InAtlas(GLuint textureName) {
+	auto b = bindings.find(textureName);
+	return b != bindings.end() && b->second.rect.z > 0;
+}
+
+void ReleaseAtlases() {
+	for (GLuint r : regions)
+		ReleaseTexture(r);			// the cache's own reference
+	regions.clear();
+	if (pages.size())
+		DeleteTextures((GLsizei) pages.size(), pages.data());
+	pages.clear();
+}
+
+// Texture Names for Parts of Textures
+
+TextureBinding ResolveTexture(GLuint textureName) {
+	auto b = bindings.find(textureName);
+	if (b != bindings.end())
+		return b->second;
+	TextureBinding t;
+	t.texture = textureName;
+	return t;
+}
+
+GLuint ReserveTextureName(TextureBinding b) {
+	// the name is never bound, so has no storage of its own
+	GLuint name = 0;
+	glGenTextures(1, &name);
+	bindings[name] = b;
+	return name;
+}
+
+void RebindTextureName(GLuint textureName, TextureBinding b) {
+	bindings[textureName] = b;
+}
+
+void ForgetTextureName(GLuint textureName) {
+	bindings.erase(textureName);
+}
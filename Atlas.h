@@ -0,0 +1,51 @@
+// Atlas.h - pack sprite images into a few large textures
+
+#ifndef ATLAS_HDR
+#define ATLAS_HDR
+
+#include <glad.h>
+#include <string>
+#include <vector>
+#include "VecMat.h"
+
+using std::string;
+using std::vector;
+
+// each packed image gets a texture name of its own (reserved, never given storage)
+// that stands for a rectangle of an atlas page; the name is registered with
+// TextureCache under the image's filename, so Sprite::Initialize picks it up,
+// and shaders map the sprite's uv into the rectangle, wrapping as GL_REPEAT would
+
+int BuildAtlas(vector<string> &imageFiles, int pageSize = 2048, int maxImageSize = 1024);
+	// pack 4-channel images no larger than maxImageSize, nor than a page less its
+	// padding (others are left to load on their own); return # pages made
+
+bool InAtlas(GLuint textureName);
+
+// Texture Names for Parts of Textures
+
+// atlas regions and texture array layers (see CacheTextureArray) are both given
+// reserved texture names; shaders take the part to sample from a TextureBinding
+
+struct TextureBinding {
+	GLuint texture = 0;				// to bind
+	GLenum target = GL_TEXTURE_2D;
+	vec4 rect;						// atlas region (xy origin, zw size), or (0,0,0,0) if whole
+	int layer = -1;					// array layer, or -1
+};
+
+TextureBinding ResolveTexture(GLuint textureName);
+	// textureName itself unless it names a part of another texture
+
+GLuint ReserveTextureName(TextureBinding b);
+	// new texture name that resolves to b
+
+void RebindTextureName(GLuint textureName, TextureBinding b);
+	// a reserved name now resolves to b (eg, a loaded texture in place of a placeholder)
+
+void ForgetTextureName(GLuint textureName);
+
+void ReleaseAtlases();
+	// once sprites using the atlases are released
+
+#endif
@@ -0,0 +1,309 @@
+// BlockCompress.cpp - encode RGBA8 images as BC1, BC3 or BC7 blocks, for compressed textures
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "BlockCompress.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define BLOCK_SSE2
+#endif
+
+namespace {
+
+// a block's 16 texels, by channel (r, g, b, a), in row order
+struct Block { float c[4][16]; };
+
+void LoadBlock(const unsigned char *rgba, int width, int height, int bx, int by, Block &b) {
+	for (int j = 0; j < 4; j++) {
+		int y = by+j < height? by+j : height-1;
+		for (int i = 0; i < 4; i++) {
+			int x = bx+i < width? bx+i : width-1;
+			const unsigned char *p = rgba+4*(y*width+x);
+			for (int k = 0; k < 4; k++)
+				b.c[k][4*j+i] = p[k];
+		}
+	}
+}
+
+float Nearest(const Block &b, int nChannels, int firstChannel, const float (*palette)[4], int nPalette, int *codes) {
+	// set each texel's code to its nearest palette entry; return summed squared error
+	float error = 0;
+	int t = 0;
+#ifdef BLOCK_SSE2
+	for (; t < 16; t += 4) {
+		__m128 best = _mm_set1_ps(1e30f);
+		__m128i bestCode = _mm_setzero_si128();
+		for (int p = 0; p < nPalette; p++) {
+			__m128 d2 = _mm_setzero_ps();
+			for (int k = 0; k < nChannels; k++) {
+				__m128 d = _mm_sub_ps(_mm_loadu_ps(b.c[firstChannel+k]+t), _mm_set1_ps(palette[p][k]));
+				d2 = _mm_add_ps(d2, _mm_mul_ps(d, d));
+			}
+			__m128i closer = _mm_castps_si128(_mm_cmplt_ps(d2, best));
+			best = _mm_min_ps(best, d2);
+			bestCode = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(p)), _mm_andnot_si128(closer, bestCode));
+		}
+		_mm_storeu_si128((__m128i *) (codes+t), bestCode);
+		float e[4];
+		_mm_storeu_ps(e, best);
+		error += e[0]+e[1]+e[2]+e[3];
+	}
+#endif
+	// scalar, without SIMD
+	for (; t < 16; t++) {
+		float best = 1e30f;
+		for (int p = 0; p < nPalette; p++) {
+			float d2 = 0;
+			for (int k = 0; k < nChannels; k++) {
+				float d = b.c[firstChannel+k][t]-palette[p][k];
+				d2 += d*d;
+			}
+			if (d2 < best) {
+				best = d2;
+				codes[t] = p;
+			}
+		}
+		error += best;
+	}
+	return error;
+}
+
+void Endpoints(const Block &b, int nChannels, float e0[4], float e1[4]) {
+	// ends of the texels' extent along their principal axis
+	float mean[4] = {0, 0, 0, 0}, cov[4][4] = {}, axis[4] = {1, 1, 1, 1};
+	for (int k = 0; k < nChannels; k++) {
+		for (int t = 0; t < 16; t++)
+			mean[k] += b.c[k][t];
+		mean[k] /= 16;
+	}
+	for (int t = 0; t < 16; t++)
+		for (int k = 0; k < nChannels; k++)
+			for (int m = 0; m < nChannels; m++)
+				cov[k][m] += (b.c[k][t]-mean[k])*(b.c[m][t]-mean[m]);
+	for (int iter = 0; iter < 8; iter++) {
+		// power iteration
+		float next[4] = {0, 0, 0, 0}, len = 0;
+		for (int k = 0; k < nChannels; k++) {
+			for (int m = 0; m < nChannels; m++)
+				next[k] += cov[k][m]*axis[m];
+			len += next[k]*next[k];
+		}
+		if (len < 1e-12f)
+			break;						// flat block: any axis will do
+		len = 1/sqrt(len);
+		for (int k = 0; k < nChannels; k++)
+			axis[k] = next[k]*len;
+	}
+	float tMin = 1e30f, tMax = -1e30f;
+	for (int t = 0; t < 16; t++) {
+		float d = 0;
+		for (int k = 0; k < nChannels; k++)
+			d += (b.c[k][t]-mean[k])*axis[k];
+		tMin = d < tMin? d : tMin;
+		tMax = d > tMax? d : tMax;
+	}
+	float norm = 0;
+	for (int k = 0; k < nChannels; k++)
+		norm += axis[k]*axis[k];
+	tMin /= norm;
+	tMax /= norm;
+	for (int k = 0; k < nChannels; k++) {
+		float v0 = mean[k]+tMin*axis[k], v1 = mean[k]+tMax*axis[k];
+		e0[k] = v0 < 0? 0 : v0 > 255? 255 : v0;
+		e1[k] = v1 < 0? 0 : v1 > 255? 255 : v1;
+	}
+}
+
+// BC1
+
+uint16_t To565(const float c[4]) {
+	int r = (int) (c[0]*31/255+.5f), g = (int) (c[1]*63/255+.5f), b = (int) (c[2]*31/255+.5f);
+	return (uint16_t) (r << 11 | g << 5 | b);
+}
+
+void From565(uint16_t v, float c[4]) {
+	int r = v >> 11, g = (v >> 5) & 63, b = v & 31;
+	c[0] = (float) (r << 3 | r >> 2);
+	c[1] = (float) (g << 2 | g >> 4);
+	c[2] = (float) (b << 3 | b >> 2);
+	c[3] = 255;
+}
+
+void ColorBlock(const Block &b, unsigned char *out) {
+	// 565 endpoints, c0 > c1 (four-color mode), then 2-bit codes
+	float e0[4], e1[4], palette[4][4];
+	Endpoints(b, 3, e0, e1);
+	uint16_t c0 = To565(e1), c1 = To565(e0);
+	if (c0 < c1) {
+		uint16_t t = c0; c0 = c1; c1 = t;
+	}
+	uint32_t bits = 0;
+	if (c0 != c1) {
+		From565(c0, palette[0]);
+		From565(c1, palette[1]);
+		for (int k = 0; k < 3; k++) {
+			palette[2][k] = (2*palette[0][k]+palette[1][k])/3;
+			palette[3][k] = (palette[0][k]+2*palette[1][k])/3;
+		}
+		int codes[16];
+		Nearest(b, 3, 0, palette, 4, codes);
+		for (int t = 0; t < 16; t++)
+			bits |= (uint32_t) codes[t] << 2*t;
+	}
+	memcpy(out, &c0, 2);
+	memcpy(out+2, &c1, 2);
+	memcpy(out+4, &bits, 4);
+}
+
+// BC3
+
+void AlphaBlock(const Block &b, unsigned char *out) {
+	// endpoints a0 > a1 (eight-value mode), then 3-bit codes
+	float lo = 255, hi = 0, palette[8][4];
+	for (int t = 0; t < 16; t++) {
+		lo = b.c[3][t] < lo? b.c[3][t] : lo;
+		hi = b.c[3][t] > hi? b.c[3][t] : hi;
+	}
+	int a0 = (int) hi, a1 = (int) lo;
+	uint64_t bits = 0;
+	if (a0 != a1) {
+		palette[0][0] = (float) a0;
+		palette[1][0] = (float) a1;
+		for (int i = 1; i < 7; i++)
+			palette[i+1][0] = (float) ((7-i)*a0+i*a1)/7;
+		int codes[16];
+		Nearest(b, 1, 3, palette, 8, codes);
+		for (int t = 0; t < 16; t++)
+			bits |= (uint64_t) codes[t] << 3*t;
+	}
+	out[0] = (unsigned char) a0;
+	out[1] = (unsigned char) a1;
+	for (int i = 0; i < 6; i++)
+		out[2+i] = (unsigned char) (bits >> 8*i);
+}
+
+// BC7, mode 6: RGBA endpoints of 7 bits plus a shared low bit (p-bit) each, 4-bit codes
+
+const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+void QuantizeBC7(const float e[4], int q[4], int &pBit) {
+	// 7-bit channels and the p-bit that together come closest to e
+	float bestError = 1e30f;
+	for (int p = 0; p < 2; p++) {
+		int t[4];
+		float error = 0;
+		for (int k = 0; k < 4; k++) {
+			int v = (int) ((e[k]-p)/2+.5f);
+			t[k] = v < 0? 0 : v > 127? 127 : v;
+			float d = (float) (t[k] << 1 | p)-e[k];
+			error += d*d;
+		}
+		if (error < bestError) {
+			bestError = error;
+			pBit = p;
+			memcpy(q, t, sizeof(t));
+		}
+	}
+}
+
+struct BitWriter {
+	unsigned char *out;
+	int at = 0;
+	BitWriter(unsigned char *out) : out(out) { memset(out, 0, 16); }
+	void Put(uint32_t value, int nBits) {
+		for (int i = 0; i < nBits; i++, at++)
+			out[at/8] |= ((value >> i) & 1) << (at%8);
+	}
+};
+
+void BC7Block(const Block &b, unsigned char *out) {
+	float e0[4], e1[4], palette[16][4];
+	Endpoints(b, 4, e0, e1);
+	int q[2][4], p[2];
+	QuantizeBC7(e0, q[0], p[0]);
+	QuantizeBC7(e1, q[1], p[1]);
+	for (int i = 0; i < 16; i++)
+		for (int k = 0; k < 4; k++) {
+			int v0 = q[0][k] << 1 | p[0], v1 = q[1][k] << 1 | p[1];
+			palette[i][k] = (float) (((64-weights[i])*v0+weights[i]*v1+32) >> 6);
+		}
+	int codes[16];
+	Nearest(b, 4, 0, palette, 16, codes);
+	if (codes[0] & 8) {
+		// the first code's high bit is implicit (0): swap endpoints, reverse codes
+		for (int k = 0; k < 4; k++) {
+			int t = q[0][k]; q[0][k] = q[1][k]; q[1][k] = t;
+		}
+		int t = p[0]; p[0] = p[1]; p[1] = t;
+		for (int i = 0; i < 16; i++)
+			codes[i] = 15-codes[i];
+	}
+	BitWriter w(out);
+	w.Put(1 << 6, 7);					// mode 6
+	for (int k = 0; k < 4; k++) {
+		w.Put(q[0][k], 7);
+		w.Put(q[1][k], 7);
+	}
+	w.Put(p[0], 1);
+	w.Put(p[1], 1);
+	w.Put(codes[0], 3);
+	for (int i = 1; i < 16; i++)
+		w.Put(codes[i], 4);
+}
+
+} // end namespace
+
+bool BlockFormatSupported(GLenum format) {
+	static int s3tc = -1, bptc = -1;
+	if (s3tc < 0) {
+		s3tc = bptc = 0;
+		GLint n = 0, major = 0, minor = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+		for (int i = 0; i < n; i++) {
+			const char *e = (const char *) glGetStringi(GL_EXTENSIONS, i);
+			if (e && !strcmp(e, "GL_EXT_texture_compression_s3tc")) s3tc = 1;
+			if (e && !strcmp(e, "GL_ARB_texture_compression_bptc")) bptc = 1;
+		}
+		glGetIntegerv(GL_MAJOR_VERSION, &major);
+		glGetIntegerv(GL_MINOR_VERSION, &minor);
+		if (major > 4 || (major == 4 && minor >= 2))
+			bptc = 1;					// core since 4.2
+	}
+	return format == BC7? bptc == 1 : format == BC1 || format == BC3? s3tc == 1 : false;
+}
+
+GLenum ChooseBlockFormat(const unsigned char *rgba, int width, int height) {
+	bool opaque = true;
+	for (int i = 0; i < width*height && opaque; i++)
+		opaque = rgba[4*i+3] == 255;
+	if (opaque)
+		return BlockFormatSupported(BC1)? BC1 : BlockFormatSupported(BC7)? BC7 : 0;
+	return BlockFormatSupported(BC7)? BC7 : BlockFormatSupported(BC3)? BC3 : 0;
+}
+
+size_t CompressedSize(GLenum format, int width, int height) {
+	return (size_t) ((width+3)/4)*((height+3)/4)*(format == BC1? 8 : 16);
+}
+
+void CompressImage(GLenum format, const unsigned char *rgba, int width, int height, unsigned char *blocks) {
+	Block b;
+	for (int by = 0; by < height; by += 4)
+		for (int bx = 0; bx < width; bx += 4) {
+			LoadBlock(rgba, width, height, bx, by, b);
+			if (format == BC1) {
+				ColorBlock(b, blocks);
+				blocks += 8;
+			}
+			if (format == BC3) {
+				AlphaBlock(b, blocks);
+				ColorBlock(b, blocks+8);
+				blocks += 16;
+			}
+			if (format == BC7) {
+				BC7Block(b, blocks);
+				blocks += 16;
+			}
+		}
+}
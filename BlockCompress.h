@@ -0,0 +1,29 @@
+// BlockCompress.h - encode RGBA8 images as BC1, BC3 or BC7 blocks, for compressed textures
+
+#ifndef BLOCK_COMPRESS_HDR
+#define BLOCK_COMPRESS_HDR
+
+#include <glad.h>
+#include <stddef.h>
+
+// each 4x4 texel block becomes 8 (BC1) or 16 (BC3, BC7) bytes: 4 or 8 bits per
+// texel rather than 32; BC1 is opaque RGB, BC3 adds a separately coded alpha,
+// BC7 (here mode 6 only) codes RGBA together with 16 shades between endpoints
+
+const GLenum BC1 = 0x83F0;		// GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+const GLenum BC3 = 0x83F3;		// GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+const GLenum BC7 = 0x8E8C;		// GL_COMPRESSED_RGBA_BPTC_UNORM
+
+bool BlockFormatSupported(GLenum format);
+	// by the current GL context
+
+GLenum ChooseBlockFormat(const unsigned char *rgba, int width, int height);
+	// BC1 if opaque, else BC7 if supported, else BC3; 0 if none is supported
+
+size_t CompressedSize(GLenum format, int width, int height);
+
+void CompressImage(GLenum format, const unsigned char *rgba, int width, int height, unsigned char *blocks);
+	// rgba is width*height*4 bytes; blocks is CompressedSize bytes; partial
+	// blocks at the right and top edges repeat the last column or row
+
+#endif
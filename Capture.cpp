@@ -0,0 +1,206 @@
+// Capture.cpp - asynchronous frame capture: readback through a ring of pixel-pack buffers, encoding on workers
+
+#include <glad.h>
+#include <algorithm>
+#include <condition_variable>
+#include <ctype.h>
+#include <deque>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include "Capture.h"
+#include "GLState.h"
+#include "STB_Image_Write.h"
+
+namespace {
+
+const int nSlots = 3;					// readbacks in flight
+const int maxQueued = 8;				// frames copied out, awaiting a consumer
+
+// GL thread only
+
+struct Slot {
+	GLuint pbo = 0;
+	size_t size = 0;
+	GLsync fence = 0;
+	int width = 0, height = 0, sequence = 0;
+	FrameConsumer consumer;
+} slots[nSlots];
+
+std::deque<int> inFlight;				// slot indices, oldest first
+int nextSlot = 0, nextSequence = 0;
+
+// shared with the encoders
+
+struct Job {
+	CapturedFrame frame;
+	FrameConsumer consumer;
+};
+
+struct Encoders {
+	vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	std::deque<Job> jobs;				// guarded by mutex
+	vector<vector<unsigned char>> spare;// pixel buffers for reuse, guarded by mutex
+	int nQueued = 0;					// jobs queued or running, guarded by mutex
+	bool quit = false;
+	~Encoders() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+		for (std::thread &t : threads)
+			t.join();
+	}
+} encoders;
+
+void Encode() {
+	for (;;) {
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(encoders.mutex);
+			encoders.wake.wait(lock, [] { return encoders.quit || !encoders.jobs.empty(); });
+			if (encoders.jobs.empty())
+				return;						// quit, with nothing left to do
+			job = std::move(encoders.jobs.front());
+			encoders.jobs.pop_front();
+		}
+		job.consumer(job.frame);
+		std::lock_guard<std::mutex> lock(encoders.mutex);
+		encoders.spare.push_back(std::move(job.frame.pixels));
+		encoders.nQueued--;
+		encoders.done.notify_all();
+	}
+}
+
+void Retire(Slot &s, bool lost = false) {
+	// copy the mapped pixels out, queue them for an encoder (waiting if too many are queued);
+	// a lost frame goes to its consumer empty (width 0), so consumers see every sequence number
+	glDeleteSync(s.fence);
+	s.fence = 0;
+	Job job;
+	{
+		std::unique_lock<std::mutex> lock(encoders.mutex);
+		encoders.done.wait(lock, [] { return encoders.nQueued < maxQueued; });
+		if (!encoders.spare.empty()) {
+			job.frame.pixels = std::move(encoders.spare.back());
+			encoders.spare.pop_back();
+		}
+	}
+	job.frame.sequence = s.sequence;
+	job.consumer = s.consumer;
+	if (!lost) {
+		job.frame.pixels.resize(s.size);
+		job.frame.width = s.width;
+		job.frame.height = s.height;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+		void *p = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, s.size, GL_MAP_READ_BIT);
+		if (p) {
+			memcpy(job.frame.pixels.data(), p, s.size);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+	else
+		job.frame.pixels.clear();
+	s.consumer = NULL;
+	if (encoders.threads.empty()) {
+		// PNG encodes far slower than frames arrive, so several at once
+		int n = std::min(4, std::max(1, (int) std::thread::hardware_concurrency()-1));
+		for (int i = 0; i < n; i++)
+			encoders.threads.emplace_back(Encode);
+	}
+	{
+		std::lock_guard<std::mutex> lock(encoders.mutex);
+		encoders.jobs.push_back(std::move(job));
+		encoders.nQueued++;
+	}
+	encoders.wake.notify_one();
+}
+
+bool RetireOldest(bool wait) {
+	if (inFlight.empty())
+		return false;
+	Slot &s = slots[inFlight.front()];
+	GLenum r;
+	do
+		r = glClientWaitSync(s.fence, wait? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait? 1000000000 : 0);
+	while (wait && r == GL_TIMEOUT_EXPIRED);
+	if (r == GL_TIMEOUT_EXPIRED)
+		return false;
+	if (r == GL_WAIT_FAILED)
+		printf("CaptureFrame: wait failed, frame %d lost\n", s.sequence);
+	Retire(s, r == GL_WAIT_FAILED);
+	inFlight.pop_front();
+	return true;
+}
+
+void Save(CapturedFrame &f, std::string filename) {
+	// drop alpha in place, then encode by extension
+	if (!f.width)
+		return;							// lost (reported by RetireOldest)
+	unsigned char *rgba = f.pixels.data(), *rgb = rgba;
+	for (int i = 0; i < f.width*f.height; i++, rgba += 4, rgb += 3)
+		memmove(rgb, rgba, 3);
+	size_t dot = filename.rfind('.');
+	std::string ext = dot == std::string::npos? "" : filename.substr(dot+1);
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	const char *name = filename.c_str();
+	unsigned char *p = f.pixels.data();
+	int ok = ext == "jpg" || ext == "jpeg"? stbi_write_jpg(name, f.width, f.height, 3, p, 100) :
+			 ext == "bmp"? stbi_write_bmp(name, f.width, f.height, 3, p) :
+			 ext == "tga"? stbi_write_tga(name, f.width, f.height, 3, p) :
+			 stbi_write_png(name, f.width, f.height, 3, p, 3*f.width);
+	if (!ok)
+		printf("CaptureFrame: can't write %s\n", name);
+}
+
+} // end namespace
+
+void CaptureFrame(FrameConsumer consumer) {
+	UpdateCaptures();
+	if ((int) inFlight.size() == nSlots)
+		RetireOldest(true);
+	int4 vp = GetViewport();
+	Slot &s = slots[nextSlot];
+	nextSlot = (nextSlot+1)%nSlots;
+	s.width = vp[2];
+	s.height = vp[3];
+	s.sequence = nextSequence++;
+	s.consumer = consumer;
+	size_t size = (size_t) 4*s.width*s.height;
+	if (!s.pbo)
+		glGenBuffers(1, &s.pbo);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+	if (s.size != size)
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+	s.size = size;
+	// into the buffer: returns at once; GL_RGBA8 rows need no pack padding
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(vp[0], vp[1], s.width, s.height, GL_RGBA, GL_UNSIGNED_BYTE, (void *) 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	inFlight.push_back((int) (&s-slots));
+}
+
+void CaptureFrame(const char *filename) {
+	std::string name(filename);
+	stbi_flip_vertically_on_write(true);	// glReadPixels rows are bottom first
+	CaptureFrame([name](CapturedFrame &f) { Save(f, name); });
+}
+
+void UpdateCaptures() {
+	while (RetireOldest(false))
+		;
+}
+
+void FinishCaptures() {
+	while (RetireOldest(true))
+		;
+	std::unique_lock<std::mutex> lock(encoders.mutex);
+	encoders.done.wait(lock, [] { return encoders.nQueued == 0; });
+}
@@ -0,0 +1,40 @@
+// Capture.h - asynchronous frame capture: readback through a ring of pixel-pack buffers, encoding on workers
+
+#ifndef CAPTURE_HDR
+#define CAPTURE_HDR
+
+#include <functional>
+#include <vector>
+
+using std::vector;
+
+// CaptureFrame starts a GL_RGBA8 read of the current viewport into the next of a
+// few pixel-pack buffers, fenced, and returns without waiting; a frame or two
+// later, once its fence has passed, the buffer is mapped, copied out, and the
+// frame handed to a worker thread to encode; no frame is dropped: if readbacks or
+// encoders fall behind (a bounded number of frames is queued), CaptureFrame waits;
+// every consumer is called, but if the GL fails the wait for a readback, its frame
+// arrives empty (width 0, no pixels), and consumers must tolerate that gap
+
+struct CapturedFrame {
+	vector<unsigned char> pixels;	// RGBA, bottom row first (as glReadPixels)
+	int width = 0, height = 0;		// 0 if the frame was lost
+	int sequence = 0;				// in order of CaptureFrame calls
+};
+
+typedef std::function<void(CapturedFrame &f)> FrameConsumer;
+	// runs on a worker thread; consumers of different frames may run concurrently
+
+void CaptureFrame(FrameConsumer consumer);
+	// call after drawing, before swapping buffers
+
+void CaptureFrame(const char *filename);
+	// save as png, jpg, bmp or tga, by extension (tga and bmp are fastest to encode)
+
+void UpdateCaptures();
+	// hand on any readbacks that have completed; CaptureFrame does this too
+
+void FinishCaptures();
+	// wait for all frames to be read and consumed
+
+#endif
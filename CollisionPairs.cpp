@@ -0,0 +1,275 @@
+// CollisionPairs.cpp - exact sprite contacts from a compute-shader pass over broadphase candidates
+
+#include <glad.h>
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include "AlphaMask.h"
+#include "CollisionPairs.h"
+#include "Draw.h"
+#include "GLState.h"
+#include "GLXtras.h"
+#include "SpatialHash.h"
+
+#if !defined(__APPLE__) && defined(GL_VERSION_4_4)
+// **** compute shader requires OpenGL 4.3, persistent mapping 4.4
+
+namespace {
+
+// std430 layouts, matching the shader
+struct SpriteData {
+	vec4 inverse[2];		// first two rows of inverse ptTransform (affine in x, y)
+	vec4 uv[2];				// first two rows of uvTransform
+	int mask[4];			// offset into mask bits, width, height, fully covered
+};
+
+struct Candidate {
+	vec4 rect;				// overlap of bounds, in NDC: xmin, ymin, xmax, ymax
+	int ids[4];				// i, j
+};
+
+const int maxDispatch = 65535; // workgroups per dispatch dimension
+
+GLuint program = 0, spriteBuffer = 0, candidateBuffer = 0, maskBuffer = 0;
+GLint pixelSizeId = -1, maxPairsId = -1, firstCandidateId = -1;
+
+// as for TestCollisionsAsync: alternate passes write separate pair buffers, copied
+// to a persistently mapped buffer and read once its fence signals, a frame or two on
+
+struct PairFrame {
+	GLuint pairs = 0, readback = 0;
+	int *mapped = NULL;				// header (# pairs), then maxPairs pairs, 4 ints each
+	int maxPairs = -1;
+	int sequence = 0;				// of submission
+	GLsync fence = NULL;
+	vector<Sprite *> sprites;		// as submitted, indexed by id
+};
+
+PairFrame pairFrames[2];
+int pairFrame = 0, nSubmitted = 0, nHarvested = 0;	// # passes
+vector<SpritePair> results;			// of the latest pass harvested
+int nResults = 0;
+
+const char *collisionPairShader = R"(
+	#version 430
+	layout(local_size_x = 64) in;
+	struct SpriteData { vec4 inverse[2]; vec4 uv[2]; ivec4 mask; };
+	struct Candidate { vec4 rect; ivec4 ids; };
+	layout(std430, binding = 0) readonly buffer Sprites { SpriteData sprites[]; };
+	layout(std430, binding = 1) readonly buffer Candidates { Candidate candidates[]; };
+	layout(std430, binding = 2) readonly buffer Masks { uint bits[]; };
+	layout(std430, binding = 3) buffer Pairs { uvec4 header; ivec4 pairs[]; };	// header.x is # pairs
+	uniform vec2 pixelSize;		// in NDC
+	uniform int maxPairs, firstCandidate;
+	shared uint count;
+	bool Covered(int s, vec2 p) {
+		// as SpriteHit: map p to quad, then uv, then mask
+		SpriteData d = sprites[s];
+		vec4 h = vec4(p, 0, 1);
+		vec2 q = vec2(dot(d.inverse[0], h), dot(d.inverse[1], h));
+		if (any(greaterThan(abs(q), vec2(1))))
+			return false;
+		if (d.mask.w != 0)
+			return true;
+		vec4 t = vec4((q+1)/2, 0, 1);
+		vec2 uv = fract(vec2(dot(d.uv[0], t), dot(d.uv[1], t)));
+		int i = min(int(uv.x*d.mask.y), d.mask.y-1), j = min(int(uv.y*d.mask.z), d.mask.z-1), k = j*d.mask.y+i;
+		return ((bits[d.mask.x+k/32] >> (k%32)) & 1u) != 0;
+	}
+	void main() {
+		Candidate c = candidates[firstCandidate+int(gl_WorkGroupID.x)];
+		if (gl_LocalInvocationIndex == 0)
+			count = 0;
+		barrier();
+		ivec2 size = ivec2(ceil((c.rect.zw-c.rect.xy)/pixelSize));
+		int n = size.x*size.y;
+		uint local = 0;
+		for (int k = int(gl_LocalInvocationIndex); k < n; k += int(gl_WorkGroupSize.x)) {
+			vec2 p = c.rect.xy+(vec2(k%size.x, k/size.x)+.5)*pixelSize;
+			if (Covered(c.ids.x, p) && Covered(c.ids.y, p))
+				local++;
+		}
+		atomicAdd(count, local);
+		barrier();
+		if (gl_LocalInvocationIndex == 0 && count > 0) {
+			uint k = atomicAdd(header.x, 1);
+			if (k < maxPairs)
+				pairs[k] = ivec4(c.ids.xy, int(count), 0);
+		}
+	}
+)";
+
+void Upload(GLuint &buffer, int binding, const void *data, size_t size) {
+	if (!buffer)
+		glGenBuffers(1, &buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, size? size : 4, data, GL_STREAM_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffer);
+}
+
+void AllocatePairFrame(PairFrame &f, int maxPairs) {
+	// f's fence has been harvested (or abandoned), so the GPU is done with its buffers
+	if (f.readback) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, f.readback);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		GLuint buffers[] = { f.pairs, f.readback };
+		glDeleteBuffers(2, buffers);
+	}
+	f.maxPairs = maxPairs;
+	GLsizeiptr size = ((size_t) maxPairs+1)*4*sizeof(int);
+	GLuint buffers[2];
+	glGenBuffers(2, buffers);
+	f.pairs = buffers[0]; f.readback = buffers[1];
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, f.pairs);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+	GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glBindBuffer(GL_COPY_WRITE_BUFFER, f.readback);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+	f.mapped = (int *) glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void HarvestPairFrame(PairFrame &f, vector<Sprite *> &sprites, GLuint64 timeout) {
+	// keep pairs whose sprites are still at the indices they were submitted with
+	if (!f.fence)
+		return;
+	GLenum r = glClientWaitSync(f.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+	if (r == GL_TIMEOUT_EXPIRED)
+		return;							// still in flight: f must not be reused yet
+	glDeleteSync(f.fence);
+	f.fence = NULL;
+	if (r == GL_WAIT_FAILED || f.sequence < nHarvested)
+		return;							// results lost, or older than those held
+	nHarvested = f.sequence;
+	int nPairs = f.mapped[0], nRead = std::min(nPairs, f.maxPairs), n = (int) sprites.size();
+	results.resize(0);
+	for (int k = 0; k < nRead; k++) {
+		const int *p = f.mapped+4*(k+1);
+		SpritePair pair;
+		pair.i = p[0];
+		pair.j = p[1];
+		pair.nPixels = p[2];
+		if (pair.j < n && sprites[pair.i] == f.sprites[pair.i] && sprites[pair.j] == f.sprites[pair.j])
+			results.push_back(pair);
+	}
+	nResults = nPairs;
+}
+
+void Submit(PairFrame &f, vector<Sprite *> &sprites, int maxPairs) {
+	int nSprites = (int) sprites.size();
+	// broadphase
+	SpatialHash hash;
+	vector<vec2> mins(nSprites), maxs(nSprites);
+	for (int i = 0; i < nSprites; i++) {
+		SpriteBounds(*sprites[i], mins[i], maxs[i]);
+		hash.Insert(mins[i], maxs[i]);			// ids are 0..n-1
+	}
+	vector<int2> overlaps;
+	hash.QueryPairs(overlaps);
+	vector<Candidate> candidates;
+	for (int2 o : overlaps) {
+		int i = o.i1 < o.i2? o.i1 : o.i2, j = o.i1 < o.i2? o.i2 : o.i1;
+		Candidate c;
+		c.rect = vec4(std::max(std::max(mins[i].x, mins[j].x), -1.f), std::max(std::max(mins[i].y, mins[j].y), -1.f),
+					  std::min(std::min(maxs[i].x, maxs[j].x), 1.f), std::min(std::min(maxs[i].y, maxs[j].y), 1.f));
+		if (c.rect.x >= c.rect.z || c.rect.y >= c.rect.w)
+			continue;							// overlap off screen
+		c.ids[0] = i; c.ids[1] = j; c.ids[2] = c.ids[3] = 0;
+		candidates.push_back(c);
+	}
+	f.sequence = ++nSubmitted;
+	if (candidates.empty()) {
+		// nothing to dispatch: no pairs, now
+		nHarvested = f.sequence;
+		results.resize(0);
+		nResults = 0;
+		return;
+	}
+	// per-sprite transforms and masks (masks are small: at most 128x128 bits)
+	vector<SpriteData> data(nSprites);
+	vector<unsigned int> bits;
+	vector<AlphaMask *> uploaded;
+	vector<int> offsets;
+	for (int i = 0; i < nSprites; i++) {
+		Sprite *s = sprites[i];
+		SpriteData &d = data[i];
+		mat4 &m = s->ptTransform;
+		float a = m[0][0], b = m[0][1], c = m[1][0], e = m[1][1], det = a*e-b*c;
+		det = fabs(det) < FLT_MIN? FLT_MIN : det;
+		d.inverse[0] = vec4(e/det, -b/det, 0, (b*m[1][3]-e*m[0][3])/det);
+		d.inverse[1] = vec4(-c/det, a/det, 0, (c*m[0][3]-a*m[1][3])/det);
+		d.uv[0] = s->uvTransform[0];
+		d.uv[1] = s->uvTransform[1];
+		AlphaMask *mask = SpriteMask(*s);
+		d.mask[3] = !mask || !mask->width? 1 : 0;
+		if (d.mask[3])
+			continue;
+		size_t k = std::find(uploaded.begin(), uploaded.end(), mask)-uploaded.begin();
+		if (k == uploaded.size()) {
+			uploaded.push_back(mask);
+			offsets.push_back((int) bits.size());
+			bits.insert(bits.end(), mask->bits.begin(), mask->bits.end());
+		}
+		d.mask[0] = offsets[k];
+		d.mask[1] = mask->width;
+		d.mask[2] = mask->height;
+	}
+	if (!program) {
+		program = LinkProgramViaCode(&collisionPairShader);
+		pixelSizeId = UniformLocation(program, "pixelSize");
+		maxPairsId = UniformLocation(program, "maxPairs");
+		firstCandidateId = UniformLocation(program, "firstCandidate");
+	}
+	Upload(spriteBuffer, 0, data.data(), data.size()*sizeof(SpriteData));
+	Upload(candidateBuffer, 1, candidates.data(), candidates.size()*sizeof(Candidate));
+	Upload(maskBuffer, 2, bits.data(), bits.size()*sizeof(unsigned int));
+	if (f.maxPairs != maxPairs)
+		AllocatePairFrame(f, maxPairs);
+	f.sprites = sprites;
+	GLuint zero = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, f.pairs);
+	glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, f.pairs);
+	UseProgram(program);
+	vec4 vp = VP();
+	SetUniform(pixelSizeId, vec2(2/vp[2], 2/vp[3]));
+	SetUniform(maxPairsId, maxPairs);
+	int nCandidates = (int) candidates.size();
+	for (int first = 0; first < nCandidates; first += maxDispatch) {
+		SetUniform(firstCandidateId, first);
+		glDispatchCompute(std::min(maxDispatch, nCandidates-first), 1, 1);
+	}
+	// copy header and pairs for the CPU, fence
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_COPY_READ_BUFFER, f.pairs);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, f.readback);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, ((size_t) maxPairs+1)*4*sizeof(int));
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	f.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	pairFrame = 1-pairFrame;
+	UseProgram(0);
+}
+
+} // end namespace
+
+int CollisionPairs(vector<Sprite *> &sprites, vector<SpritePair> &pairs, int maxPairs) {
+	PairFrame &f = pairFrames[pairFrame], &last = pairFrames[1-pairFrame];
+	// f was submitted two passes ago; finish with it before its buffers are reused
+	HarvestPairFrame(f, sprites, 1000000000);
+	HarvestPairFrame(last, sprites, 0);
+	if (!f.fence)
+		Submit(f, sprites, maxPairs);	// else GPU a second behind: skip this pass
+	pairs = results;
+	return nResults;
+}
+
+#else
+
+int CollisionPairs(vector<Sprite *> &sprites, vector<SpritePair> &pairs, int maxPairs) {
+	pairs.resize(0);
+	return -1;
+}
+
+#endif
@@ -0,0 +1,27 @@
+// CollisionPairs.h - exact sprite contacts from a compute-shader pass over broadphase candidates
+
+#ifndef COLLISION_PAIRS_HDR
+#define COLLISION_PAIRS_HDR
+
+#include <vector>
+#include "Sprite.h"
+
+using std::vector;
+
+// candidate pairs come from a SpatialHash over the sprites' bounds; one compute
+// workgroup per candidate then samples both sprites' alpha masks at every screen
+// pixel of their overlap; pairs with covered pixels in common are appended to
+// an output buffer, so results are independent of z and draw order; the buffer is
+// fenced and read a frame or two later, so the CPU never waits on the pass
+
+struct SpritePair {
+	int i = 0, j = 0;		// indices into the sprites given, i < j
+	int nPixels = 0;		// # screen pixels covered by both
+};
+
+int CollisionPairs(vector<Sprite *> &sprites, vector<SpritePair> &pairs, int maxPairs = 4096);
+	// start a pass over sprites; return # colliding pairs found by the latest pass to
+	// finish (pairs holds at most maxPairs, less any whose sprites have since changed
+	// index); -1 if compute shaders or persistent mapping (OpenGL 4.4) unsupported
+
+#endif
@@ -0,0 +1,84 @@
+// DistanceField.cpp - signed distance fields from coverage rasters, for text crisp at any scale
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include "DistanceField.h"
+
+namespace {
+
+const float far = 1e20f;
+
+void Transform1D(const float *f, int n, float *d, int *v, float *z) {
+	// squared distance transform of sampled function f (Felzenszwalb & Huttenlocher)
+	int k = 0;
+	v[0] = 0;
+	z[0] = -far;
+	z[1] = far;
+	for (int q = 1; q < n; q++) {
+		float s;
+		while ((s = ((f[q]+q*q)-(f[v[k]]+v[k]*v[k]))/(2*q-2*v[k])) <= z[k])
+			k--;
+		k++;
+		v[k] = q;
+		z[k] = s;
+		z[k+1] = far;
+	}
+	for (int q = 0, k2 = 0; q < n; q++) {
+		while (z[k2+1] < q)
+			k2++;
+		d[q] = (q-v[k2])*(q-v[k2])+f[v[k2]];
+	}
+}
+
+void Transform2D(vector<float> &grid, int w, int h) {
+	// separable: columns, then rows
+	int n = std::max(w, h);
+	vector<float> f(n), d(n), z(n+1);
+	vector<int> v(n);
+	for (int x = 0; x < w; x++) {
+		for (int y = 0; y < h; y++)
+			f[y] = grid[y*w+x];
+		Transform1D(f.data(), h, d.data(), v.data(), z.data());
+		for (int y = 0; y < h; y++)
+			grid[y*w+x] = d[y];
+	}
+	for (int y = 0; y < h; y++) {
+		Transform1D(&grid[y*w], w, d.data(), v.data(), z.data());
+		std::copy(d.begin(), d.begin()+w, grid.begin()+y*w);
+	}
+}
+
+} // end namespace
+
+void DistanceField(const unsigned char *coverage, int width, int height, int spread,
+				   vector<unsigned char> &field, int upsample) {
+	int w = width*upsample, h = height*upsample;
+	vector<bool> inside(w*h);
+	for (int y = 0; y < h; y++)
+		for (int x = 0; x < w; x++) {
+			// bilinear sample at field pixel center
+			float sx = std::max(0.f, (x+.5f)/upsample-.5f), sy = std::max(0.f, (y+.5f)/upsample-.5f);
+			int x0 = std::min((int) sx, width-1), y0 = std::min((int) sy, height-1);
+			int x1 = std::min(x0+1, width-1), y1 = std::min(y0+1, height-1);
+			float ax = sx-x0, ay = sy-y0;
+			float top = (1-ax)*coverage[y0*width+x0]+ax*coverage[y0*width+x1];
+			float bot = (1-ax)*coverage[y1*width+x0]+ax*coverage[y1*width+x1];
+			inside[y*w+x] = (1-ay)*top+ay*bot >= 128;
+		}
+	// squared distance to nearest inside pixel, and to nearest outside pixel
+	vector<float> toInside(w*h), toOutside(w*h);
+	for (int i = 0; i < w*h; i++) {
+		toInside[i] = inside[i]? 0 : far;
+		toOutside[i] = inside[i]? far : 0;
+	}
+	Transform2D(toInside, w, h);
+	Transform2D(toOutside, w, h);
+	field.resize(w*h);
+	for (int i = 0; i < w*h; i++) {
+		// edge lies half a pixel from the nearest pixel across it
+		float d = inside[i]? sqrt(toOutside[i])-.5f : -(sqrt(toInside[i])-.5f);
+		float t = 128+127*d/spread;
+		field[i] = (unsigned char) std::min(255.f, std::max(0.f, t+.5f));
+	}
+}
@@ -0,0 +1,20 @@
+// DistanceField.h - signed distance fields from coverage rasters, for text crisp at any scale
+
+#ifndef DISTANCE_FIELD_HDR
+#define DISTANCE_FIELD_HDR
+
+#include <vector>
+
+using std::vector;
+
+// the field is stored as bytes: 128 on the shape's edge, rising to 255 at spread
+// (field) pixels inside, falling to 0 at spread pixels outside; a shader draws
+// the shape by thresholding at .5, antialiased over fwidth, so one field serves
+// any magnification
+
+void DistanceField(const unsigned char *coverage, int width, int height, int spread,
+				   vector<unsigned char> &field, int upsample = 1);
+	// coverage is 0 (outside) to 255 (inside), row-major; the field is width*upsample
+	// by height*upsample, from coverage bilinearly resampled and thresholded at 128
+
+#endif
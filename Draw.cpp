@@ -3,6 +3,8 @@
 
 #include <glad.h>
 #include "Draw.h"
+#include "DrawList.h"
+#include "GLState.h"
 #include "GLXtras.h"
 #include "Text.h"
 #include <float.h>
@@ -12,26 +14,20 @@
 
 using std::string;
 
-// viewport operations
+// viewport operations (shadowed, see GLState.h)
 
 void VPsize(int &width, int &height) {
-	int vp[4];
-	glGetIntegerv(GL_VIEWPORT, vp);
+	int4 vp = GetViewport();
 	width = vp[2];
 	height = vp[3];
 }
 
 vec4 VP() {
-	vec4 vp;
-	glGetFloatv(GL_VIEWPORT, (float *) &vp);
-	return vp;
+	int4 vp = GetViewport();
+	return vec4((float) vp[0], (float) vp[1], (float) vp[2], (float) vp[3]);
 }
 
-int4 VPi() {
-	int4 vp;
-	glGetIntegerv(GL_VIEWPORT, (int *) &vp);
-	return vp;
-}
+int4 VPi() { return GetViewport(); }
 
 int VPw() { return VPi()[2]; }
 
@@ -39,8 +35,7 @@ int VPh() { return VPi()[3]; }
 
 mat4 Viewport() {
 	// map +/-1 space to screen space viewport
-	float vp[4];
-	glGetFloatv(GL_VIEWPORT, vp);
+	vec4 vp = VP();
 	float x = vp[0], y = vp[1], w = vp[2], h = vp[3];
 	return mat4(vec4(w/2,0,0,x+w/2), vec4(0,h/2,0,y+h/2), vec4(0,0,1,0), vec4(0,0,0,1));
 		// **** something wrong here?
@@ -76,9 +71,9 @@ void UnProjectInv(float xscreen, float yscreen, float zscreen, mat4 &inv, vec3 &
 // misc operations
 
 bool DepthXY(int x, int y, float &depth) {
-	if (glIsEnabled(GL_DEPTH_TEST)) {
-		float v, depthRange[2]; // depthRange maps to window coordinates +/-1
-		glGetFloatv(GL_DEPTH_RANGE, depthRange);
+	if (IsEnabled(GL_DEPTH_TEST)) {
+		float v;
+		vec2 depthRange = GetDepthRange(); // depthRange maps to window coordinates +/-1
 		glReadPixels(x, y, 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &v);
 		depth = -1+2*(v-depthRange[0])/(depthRange[1]-depthRange[0]);
 		return true;
@@ -96,8 +91,7 @@ bool FrontFacing(vec3 base, vec3 vec, mat4 view) {
 
 mat4 ScreenMode() {
 	// map pixel space (xorigin, yorigin)-(xorigin+width,yorigin+height) to NDC (clip) space (-1,-1)-(1,1)
-	float vp[4];
-	glGetFloatv(GL_VIEWPORT, vp);
+	vec4 vp = VP();
 	float x = vp[0], y = vp[1], w = vp[2], h = vp[3];
 	return Translate(-1, -1, 0)*Scale(2/w, 2/h, 1)*Translate(-x, -y, 0);
 }
@@ -343,11 +337,10 @@ mat4 GetDrawView() { return drawView; }
 void SetDrawView(mat4 m) { SetUniform(drawShader, "view", drawView = m); }
 
 GLuint UseDrawShader() {
-	int was = 0;
-	glGetIntegerv(GL_CURRENT_PROGRAM, &was);
+	int was = GetProgram();
 	bool init = !drawShader;
 	if (init) drawShader = LinkProgramViaCode(&drawVShader, &drawPShader);
-	glUseProgram(drawShader);
+	UseProgram(drawShader);
 	if (init) drawView = mat4();
 	SetUniform(drawShader, "view", drawView);
 	return was;
@@ -360,6 +353,10 @@ GLuint UseDrawShader(mat4 viewMatrix) {
 	return was;
 }
 
+// multi-primitive shapes record into one list, drawn with a single upload
+
+namespace { DrawList drawList; }
+
 // Disks
 
 GLuint diskVBO = 0, diskVAO = 0;
@@ -375,11 +372,11 @@ void Disk(vec3 p, float diameter, vec3 color, float opacity, bool ring) {
 	if (!diskVBO) {
 		glGenVertexArrays(1, &diskVAO);
 		glGenBuffers(1, &diskVBO);
-		glBindVertexArray(diskVAO);
+		BindVertexArray(diskVAO);
 		glBindBuffer(GL_ARRAY_BUFFER, diskVBO);
 		glBufferData(GL_ARRAY_BUFFER, 2*sizeof(vec3), NULL, GL_STATIC_DRAW);
 	}
-	glBindVertexArray(diskVAO);
+	BindVertexArray(diskVAO);
 	glBindBuffer(GL_ARRAY_BUFFER, diskVBO); // set active buffer
 	// allocate buffer memory and load location and color data
 	glBufferSubData(GL_ARRAY_BUFFER, 0, 3*sizeof(float), &p.x);
@@ -388,19 +385,19 @@ void Disk(vec3 p, float diameter, vec3 color, float opacity, bool ring) {
 	VertexAttribPointer(drawShader, "position", 3, 0, (void *) 0);
 	VertexAttribPointer(drawShader, "color", 3, 0, (void *) sizeof(vec3));
 	// draw
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	Enable(GL_BLEND);
+	BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	SetUniform(drawShader, "opacity", opacity);
 	SetUniform(drawShader, "ring", ring);
 	glPointSize(diameter);
 /* #ifdef GL_POINT_SMOOTH
-	glEnable(GL_POINT_SMOOTH);
+	Enable(GL_POINT_SMOOTH);
 #endif
 #if !defined(GL_POINT_SMOOTH) && defined(GL_POINT_SPRITE)
-	glEnable(GL_POINT_SPRITE);
+	Enable(GL_POINT_SPRITE);
 #endif
 #if !defined(GL_POINT_SMOOTH) && !defined(GL_POINT_SPRITE) */
-	glEnable(0x8861); // same as GL_POINT_SMOOTH [this is a 4.5 core bug]
+	Enable(0x8861); // same as GL_POINT_SMOOTH [this is a 4.5 core bug]
 	SetUniform(drawShader, "fadeToCenter", true); // needed if GL_POINT_SMOOTH and GL_POINT_SPRITE fail
 // #endif
 	glDrawArrays(GL_POINTS, 0, 1);
@@ -418,12 +415,12 @@ void Line(vec3 p1, vec3 p2, float width, vec3 col1, vec3 col2, float opacity) {
 	if (!lineVBO) {
 		glGenVertexArrays(1, &lineVAO);
 		glGenBuffers(1, &lineVBO);
-		glBindVertexArray(lineVAO);
+		BindVertexArray(lineVAO);
 		glBindBuffer(GL_ARRAY_BUFFER, lineVBO);
 		glBufferData(GL_ARRAY_BUFFER, sizeof(data), NULL, GL_STATIC_DRAW);
 	}
 	// set active vertex buffer, load location and color data
-	glBindVertexArray(lineVAO);
+	BindVertexArray(lineVAO);
 	glBindBuffer(GL_ARRAY_BUFFER, lineVBO);
 	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(data), (void *) data);
 	// connect shader inputs, set uniforms
@@ -464,8 +461,9 @@ void LineDash(vec3 p1, vec3 p2, float width, vec3 col1, vec3 col2, float opacity
 	vec3 seg = (p2-p1)/(float)nDashes, dash = percentDash*seg;
 	for (int i = 0; i < nDashes; i++) {
 		vec3 start = p1+(float)i*seg;
-		Line(start, start+dash, width, col1, col2, opacity);
+		drawList.Line(start, start+dash, width, col1, col2, opacity);
 	}
+	drawList.Flush();
 }
 
 void LineDot(vec3 p1, vec3 p2, float width, vec3 col, float opacity, int pixelSpacing) {
@@ -473,7 +471,8 @@ void LineDot(vec3 p1, vec3 p2, float width, vec3 col, float opacity, int pixelSp
 	int nDots = (int) (totalLen/(float)pixelSpacing);
 	vec3 d = (p2-p1)/(float)nDots;
 	for (int i = 0; i < nDots; i++)
-		Disk(p1+(float)i*d, width, col);
+		drawList.Disk(p1+(float)i*d, width, col);
+	drawList.Flush();
 }
 /*
 void LineDot(vec3 p1, vec3 p2, mat4 view, float width, vec3 col, float opacity, int pixelSpacing) {
@@ -492,11 +491,11 @@ void LineStrip(int nPoints, vec3 *points, vec3 &color, float opacity, float widt
 	if (!lineStripVBO) {
 		glGenVertexArrays(1, &lineStripVAO);
 		glGenBuffers(1, &lineStripVBO);
-		glBindVertexArray(lineStripVAO);
+		BindVertexArray(lineStripVAO);
 		glBindBuffer(GL_ARRAY_BUFFER, lineStripVBO);
 		glBufferData(GL_ARRAY_BUFFER, 2*pSize, NULL, GL_STATIC_DRAW);
 	}
-	glBindVertexArray(lineStripVAO);
+	BindVertexArray(lineStripVAO);
 	glBindBuffer(GL_ARRAY_BUFFER, lineStripVBO);
 	std::vector<vec3> colors(nPoints, color);
 	glBufferSubData(GL_ARRAY_BUFFER, 0, pSize, points);
@@ -520,27 +519,29 @@ void QuadInner(vec3 p1, vec3 p2, vec3 p3, vec3 p4, bool solid, vec3 col, float o
 	Triangle(p1, p2, p3, col, col, col, opacity, !solid, col, lineWidth);
 	Triangle(p1, p3, p4, col, col, col, opacity, !solid, col, lineWidth);
 #else
+	if (!texture) {
+		// as Box, through the draw list: two triangles, or four lines
+		drawList.Quad(p1, p2, p3, p4, solid, col, opacity, lineWidth);
+		drawList.Flush();
+		return;
+	}
 	vec3 data[] = { p1, p2, p3, p4, col, col, col, col };
 	UseDrawShader();
 	if (quadVBO == 0) {
 		glGenVertexArrays(1, &quadVAO);
 		glGenBuffers(1, &quadVBO);
-		glBindVertexArray(quadVAO);
-		glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(data), NULL, GL_STATIC_DRAW);
 	}
-	glBindVertexArray(quadVAO);
+	BindVertexArray(quadVAO);
 	glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(data), data);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(data), data, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(data), data, GL_STREAM_DRAW);
 	VertexAttribPointer(drawShader, "position", 3, 0, (void *) 0);
 	VertexAttribPointer(drawShader, "color", 3, 0, (void *) (4*sizeof(vec3)));
 	SetUniform(drawShader, "opacity", opacity);
 	SetUniform(drawShader, "fadeToCenter", false);
 	SetUniform(drawShader, "useTexture", texture);
 	if (texture) {
-		glActiveTexture(GL_TEXTURE0+textureUnit);
-		glBindTexture(GL_TEXTURE_2D, textureName);
+		ActiveTexture(GL_TEXTURE0+textureUnit);
+		BindTexture(GL_TEXTURE_2D, textureName);
 		SetUniform(drawShader, "textureImage", textureUnit);
 		SetUniform(drawShader, "nTexChannels", nTexChannels);
 	}
@@ -569,19 +570,8 @@ void Quad(float x1, float y1, float x2, float y2, float x3, float y3, float x4,
 // Star
 
 void Star(vec3 p, float size, vec3 color) {
-	mat4 mSave = drawView;
-	vec2 s = ScreenPoint(p, drawView);
-	UseDrawShader(ScreenMode());
-	Disk(s, size, color);
-	for (int i = 0, nRays = 8; i < nRays; i++) {
-		float a = 3.1415f*(float)i/nRays;
-		float r1 = 1.02f*size, r2 = size*(i%2? 1.7f : 2.1f), w = i%2? 1 : 1.75f;
-		vec3 c = color; // i%2? vec3(0, 0, 1) : color;
-		vec2 d(cos(a), sin(a));
-		Line(s+r1*d, s+r2*d, w, c);
-		Line(s-r1*d, s-r2*d, w, c);
-	}
-	UseDrawShader(mSave);
+	drawList.Star(p, size, color);
+	drawList.Flush();
 }
 
 void Star(vec3 p, float size, vec3 colorVisible, vec3 colorHidden) {
@@ -591,13 +581,14 @@ void Star(vec3 p, float size, vec3 colorVisible, vec3 colorHidden) {
 // Arrow
 
 void Arrow(vec2 base, vec2 head, vec3 col, float lineWidth, double headSize) {
-	Line(base, head, lineWidth, col);
+	drawList.Line(base, head, lineWidth, col);
 	if (headSize > 0) {
 		vec2 v1 = (float)headSize*normalize(head-base), v2(v1.y/2.f, -v1.x/2.f);
 		vec2 head1(head-v1+v2), head2(head-v1-v2);
-		Line(head, head1, lineWidth, col);
-		Line(head, head2, lineWidth, col);
+		drawList.Line(head, head1, lineWidth, col);
+		drawList.Line(head, head2, lineWidth, col);
 	}
+	drawList.Flush();
 }
 
 vec3 ProjectToLine(vec3 p, vec3 p1, vec3 p2) {
@@ -723,7 +714,7 @@ void Cylinder(vec3 p1, vec3 p2, float r1, float r2, mat4 modelview, mat4 persp,
 	if (!cylinderShader)
 		cylinderShader = LinkProgramViaCode(&cylVShader, &cylTCShader, &cylTEShader, NULL, &cylPShader);
 	//	cylinderShader = LinkProgramViaCode(&vShader, NULL, &teShader, NULL, &pShader);
-	glUseProgram(cylinderShader);
+	UseProgram(cylinderShader);
 	SetUniform(cylinderShader, "modelview", modelview);
 	SetUniform(cylinderShader, "persp", persp);
 	SetUniform(cylinderShader, "color", color);
@@ -836,12 +827,12 @@ GLuint UseTriangleShader() {
 	bool init = triShader == 0;
 	if (init)
 		triShader = LinkProgramViaCode(&triVShaderCode, NULL, NULL, &triGShaderCode, &triPShaderCode);
-	glUseProgram(triShader);
+	UseProgram(triShader);
 	if (init)
 		SetUniform(triShader, "view", mat4());
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glEnable(GL_LINE_SMOOTH);
+	Enable(GL_BLEND);
+	BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	Enable(GL_LINE_SMOOTH);
 	return triShader;
 }
 
@@ -858,14 +849,10 @@ void Triangle(vec3 p1, vec3 p2, vec3 p3, vec3 c1, vec3 c2, vec3 c3,
 	if (triVBO == 0) {
 		glGenVertexArrays(1, &triVAO);
 		glGenBuffers(1, &triVBO);
-		glBindVertexArray(triVAO);
-		glBindBuffer(GL_ARRAY_BUFFER, triVBO);
-		glBufferData(GL_ARRAY_BUFFER, 3*sizeof(vec3), NULL, GL_STATIC_DRAW);
 	}
-	glBindVertexArray(triVAO);
+	BindVertexArray(triVAO);
 	glBindBuffer(GL_ARRAY_BUFFER, triVBO);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, 3*sizeof(vec3), data);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(data), data, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(data), data, GL_STREAM_DRAW);
 	VertexAttribPointer(triShader, "point", 3, 0, (void *) 0);
 	VertexAttribPointer(triShader, "color", 3, 0, (void *) (3*sizeof(vec3)));
 	SetUniform(triShader, "viewptM", Viewport()); // **** ????
@@ -880,20 +867,7 @@ void Triangle(vec3 p1, vec3 p2, vec3 p3, vec3 c1, vec3 c2, vec3 c3,
 // Boxes
 
 void Box(vec3 a, vec3 b, float width, vec3 col) {
-	float x1=a.x, x2=b.x, y1=a.y, y2=b.y, z1=a.z, z2=b.z;
-	// left-right
-	Line(vec3(x1,y1,z1), vec3(x2,y1,z1), width, col);
-	Line(vec3(x1,y2,z1), vec3(x2,y2,z1), width, col);
-	Line(vec3(x1,y1,z2), vec3(x2,y1,z2), width, col);
-	Line(vec3(x1,y2,z2), vec3(x2,y2,z2), width, col);
-	// bottom-top
-	Line(vec3(x1,y1,z1), vec3(x1,y2,z1), width, col);
-	Line(vec3(x1,y1,z2), vec3(x1,y2,z2), width, col);
-	Line(vec3(x2,y1,z1), vec3(x2,y2,z1), width, col);
-	Line(vec3(x2,y1,z2), vec3(x2,y2,z2), width, col);
-	// near-far
-	Line(vec3(x1,y1,z1), vec3(x1,y1,z2), width, col);
-	Line(vec3(x1,y2,z1), vec3(x1,y2,z2), width, col);
-	Line(vec3(x2,y1,z1), vec3(x2,y1,z2), width, col);
-	Line(vec3(x2,y2,z1), vec3(x2,y2,z2), width, col);
+	// 12 edges, one draw
+	drawList.Box(a, b, width, col);
+	drawList.Flush();
 }
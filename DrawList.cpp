@@ -0,0 +1,191 @@
+// DrawList.cpp - batched immediate-mode lines, disks, triangles
+
+#include <string.h>
+#include "Draw.h"
+#include "DrawList.h"
+#include "GLState.h"
+#include "GLXtras.h"
+
+void DrawList::Clear() {
+	vertices.resize(0);
+	runs.resize(0);
+}
+
+void DrawList::Release() {
+	if (vbo > 0)
+		glDeleteBuffers(1, &vbo);
+	if (vao > 0)
+		DeleteVertexArrays(1, &vao);
+	vao = vbo = 0;
+	Clear();
+}
+
+void DrawList::SetView(mat4 m) {
+	view = m;
+	ownView = true;
+}
+
+void DrawList::UseDrawView() { ownView = false; }
+
+mat4 DrawList::View() { return ownView? view : GetDrawView(); }
+
+DrawList::Vertex *DrawList::Add(GLenum mode, float size, float opacity, bool ring, const mat4 &view, int nVertices) {
+	Run *r = runs.empty()? NULL : &runs.back();
+	bool same = r && r->mode == mode && r->size == size && r->opacity == opacity && r->ring == ring &&
+				!memcmp(&r->view, &view, sizeof(mat4));
+	if (same)
+		r->count += nVertices;
+	else
+		runs.push_back({ mode, size, opacity, ring, view, (int) vertices.size(), nVertices });
+	vertices.resize(vertices.size()+nVertices);
+	return vertices.data()+vertices.size()-nVertices;
+}
+
+// Lines
+
+void DrawList::Line(vec3 p1, vec3 p2, float width, vec3 col1, vec3 col2, float opacity) {
+	Vertex *v = Add(GL_LINES, width, opacity, false, View(), 2);
+	v[0] = { p1, col1 };
+	v[1] = { p2, col2 };
+}
+
+void DrawList::Line(vec3 p1, vec3 p2, float width, vec3 col, float opacity) {
+	Line(p1, p2, width, col, col, opacity);
+}
+
+void DrawList::Line(vec2 p1, vec2 p2, float width, vec3 col, float opacity) {
+	Line(vec3(p1, 0), vec3(p2, 0), width, col, col, opacity);
+}
+
+void DrawList::Line(int x1, int y1, int x2, int y2, float width, vec3 col, float opacity) {
+	Line(vec3((float) x1, (float) y1, 0), vec3((float) x2, (float) y2, 0), width, col, col, opacity);
+}
+
+void DrawList::Box(vec3 a, vec3 b, float width, vec3 col) {
+	float x1=a.x, x2=b.x, y1=a.y, y2=b.y, z1=a.z, z2=b.z;
+	// left-right
+	Line(vec3(x1,y1,z1), vec3(x2,y1,z1), width, col);
+	Line(vec3(x1,y2,z1), vec3(x2,y2,z1), width, col);
+	Line(vec3(x1,y1,z2), vec3(x2,y1,z2), width, col);
+	Line(vec3(x1,y2,z2), vec3(x2,y2,z2), width, col);
+	// bottom-top
+	Line(vec3(x1,y1,z1), vec3(x1,y2,z1), width, col);
+	Line(vec3(x1,y1,z2), vec3(x1,y2,z2), width, col);
+	Line(vec3(x2,y1,z1), vec3(x2,y2,z1), width, col);
+	Line(vec3(x2,y1,z2), vec3(x2,y2,z2), width, col);
+	// near-far
+	Line(vec3(x1,y1,z1), vec3(x1,y1,z2), width, col);
+	Line(vec3(x1,y2,z1), vec3(x1,y2,z2), width, col);
+	Line(vec3(x2,y1,z1), vec3(x2,y1,z2), width, col);
+	Line(vec3(x2,y2,z1), vec3(x2,y2,z2), width, col);
+}
+
+// Disks
+
+void DrawList::Disk(vec3 p, float diameter, vec3 color, float opacity, bool ring) {
+	Vertex *v = Add(GL_POINTS, diameter, opacity, ring, View(), 1);
+	v[0] = { p, color };
+}
+
+void DrawList::Disk(vec2 p, float diameter, vec3 color, float opacity, bool ring) {
+	Disk(vec3(p, 0), diameter, color, opacity, ring);
+}
+
+// Triangles and Quads
+
+void DrawList::Triangle(vec3 p1, vec3 p2, vec3 p3, vec3 c1, vec3 c2, vec3 c3, float opacity) {
+	Vertex *v = Add(GL_TRIANGLES, 0, opacity, false, View(), 3);
+	v[0] = { p1, c1 };
+	v[1] = { p2, c2 };
+	v[2] = { p3, c3 };
+}
+
+void DrawList::Quad(vec3 p1, vec3 p2, vec3 p3, vec3 p4, bool solid, vec3 col, float opacity, float lineWidth) {
+	if (solid) {
+		Triangle(p1, p2, p3, col, col, col, opacity);
+		Triangle(p1, p3, p4, col, col, col, opacity);
+	}
+	else {
+		Line(p1, p2, lineWidth, col, opacity);
+		Line(p2, p3, lineWidth, col, opacity);
+		Line(p3, p4, lineWidth, col, opacity);
+		Line(p4, p1, lineWidth, col, opacity);
+	}
+}
+
+// Star
+
+void DrawList::Star(vec3 p, float size, vec3 color) {
+	// as Star in Draw.h: disk and rays in pixels about p's screen location
+	mat4 screen = ScreenMode();
+	vec2 s = ScreenPoint(p, View());
+	Add(GL_POINTS, size, 1, false, screen, 1)[0] = { vec3(s, 0), color };
+	for (int i = 0, nRays = 8; i < nRays; i++) {
+		float a = 3.1415f*(float)i/nRays;
+		float r1 = 1.02f*size, r2 = size*(i%2? 1.7f : 2.1f), w = i%2? 1 : 1.75f;
+		vec2 d(cos(a), sin(a)), ends[] = { s+r1*d, s+r2*d, s-r1*d, s-r2*d };
+		Vertex *v = Add(GL_LINES, w, 1, false, screen, 4);
+		for (int k = 0; k < 4; k++)
+			v[k] = { vec3(ends[k], 0), color };
+	}
+}
+
+// Flush
+
+void DrawList::Flush() {
+	if (runs.empty())
+		return;
+	GLuint shader = GetDrawShader();
+	// uniform locations cached per shader, rather than looked up by name per draw
+	static GLuint locShader = 0;
+	static GLint viewLoc, opacityLoc, fadeLoc, ringLoc, textureLoc;
+	if (locShader != shader) {
+		locShader = shader;
+		viewLoc = UniformLocation(shader, "view");
+		opacityLoc = UniformLocation(shader, "opacity");
+		fadeLoc = UniformLocation(shader, "fadeToCenter");
+		ringLoc = UniformLocation(shader, "ring");
+		textureLoc = UniformLocation(shader, "useTexture");
+	}
+	UseProgram(shader);
+	if (!vao) {
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(1, &vbo);
+		BindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		VertexAttribPointer(shader, "position", 3, sizeof(Vertex), (void *) 0);
+		VertexAttribPointer(shader, "color", 3, sizeof(Vertex), (void *) sizeof(vec3));
+	}
+	BindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	// one upload (orphaning the previous store) for the whole list
+	glBufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(Vertex), vertices.data(), GL_STREAM_DRAW);
+	SetUniform(textureLoc, false);
+	const Run *prev = NULL;
+	for (const Run &r : runs) {
+		if (!prev || memcmp(&prev->view, &r.view, sizeof(mat4)))
+			SetUniform(viewLoc, r.view);
+		if (!prev || prev->opacity != r.opacity)
+			SetUniform(opacityLoc, r.opacity);
+		if (!prev || prev->ring != r.ring)
+			SetUniform(ringLoc, r.ring);
+		if (!prev || prev->mode != r.mode) {
+			SetUniform(fadeLoc, r.mode == GL_POINTS);	// gl_PointCoord fails for lines
+			if (r.mode == GL_POINTS) {
+				Enable(GL_BLEND);
+				BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+				Enable(0x8861);						// same as GL_POINT_SMOOTH
+			}
+		}
+		if (r.mode == GL_POINTS)
+			glPointSize(r.size);
+		if (r.mode == GL_LINES)
+			glLineWidth(r.size);
+		glDrawArrays(r.mode, r.start, r.count);
+		prev = &r;
+	}
+	// as UseDrawShader, leave the shader's view as the current draw view
+	SetUniform(viewLoc, GetDrawView());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	Clear();
+}
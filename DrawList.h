@@ -0,0 +1,51 @@
+// DrawList.h - batched immediate-mode lines, disks, triangles
+
+#ifndef DRAW_LIST_HDR
+#define DRAW_LIST_HDR
+
+#include <glad.h>
+#include <vector>
+#include "VecMat.h"
+
+using std::vector;
+
+// primitives are recorded into a growable vertex arena, with the draw view current
+// at record time (see UseDrawShader) or as given by SetView; Flush uploads the arena once, then issues one
+// glDrawArrays per run of like state (mode, width or diameter, opacity, ring, view)
+
+class DrawList {
+public:
+	void SetView(mat4 m);
+		// record subsequent primitives with m, rather than the current draw view
+	void UseDrawView();
+		// revert to the current draw view
+	void Line(vec3 p1, vec3 p2, float width, vec3 col1, vec3 col2, float opacity = 1);
+	void Line(vec3 p1, vec3 p2, float width = 1, vec3 col = vec3(0,0,0), float opacity = 1);
+	void Line(vec2 p1, vec2 p2, float width = 1, vec3 col = vec3(0,0,0), float opacity = 1);
+	void Line(int x1, int y1, int x2, int y2, float width = 1, vec3 col = vec3(0,0,0), float opacity = 1);
+	void Disk(vec3 p, float diameter, vec3 color, float opacity = 1, bool ring = false);
+	void Disk(vec2 p, float diameter, vec3 color, float opacity = 1, bool ring = false);
+	void Triangle(vec3 p1, vec3 p2, vec3 p3, vec3 c1, vec3 c2, vec3 c3, float opacity = 1);
+		// solid only; for outlines, use Triangle in Draw.h
+	void Quad(vec3 p1, vec3 p2, vec3 p3, vec3 p4, bool solid = true, vec3 col = vec3(0,0,0), float opacity = 1, float lineWidth = 1);
+	void Star(vec3 p, float size, vec3 color);
+	void Box(vec3 a, vec3 b, float width = 1, vec3 col = vec3(0,0,0));
+	void Flush();
+		// draw and empty the list; leaves the draw shader in use
+	void Clear();
+	void Release();
+		// free GPU buffers
+	int NVertices() { return (int) vertices.size(); }
+private:
+	struct Vertex { vec3 p, col; };
+	struct Run { GLenum mode; float size, opacity; bool ring; mat4 view; int start, count; };
+	vector<Vertex> vertices;
+	vector<Run> runs;
+	GLuint vao = 0, vbo = 0;
+	bool ownView = false;
+	mat4 view;
+	mat4 View();
+	Vertex *Add(GLenum mode, float size, float opacity, bool ring, const mat4 &view, int nVertices);
+};
+
+#endif
@@ -0,0 +1,237 @@
+// Entities.cpp - structure-of-arrays storage for tank creatures and items
+
+#include <math.h>
+#include <string.h>
+#include "Entities.h"
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define SWIM_SSE2
+#endif
+
+namespace {
+
+Affine2 Xform(float x, float y, float sx, float sy, bool facingRight) {
+	Affine2 m;
+	m.a = facingRight? sx : -sx;
+	m.d = sy;
+	m.tx = x;
+	m.ty = y;
+	return m;
+}
+
+void Finish(Entities &e, int i, int lanes, int right, int left, vector<int> &turns) {
+	// per-entity tail of a Swim step: bits of right, left are lanes with vx > 0, vx < 0
+	for (int k = 0; k < lanes; k++) {
+		int m = i+k;
+		unsigned char f = (right>>k)&1? 1 : (left>>k)&1? 0 : e.facingRight[m];
+		if (f != e.facingRight[m])
+			turns.push_back(m);
+		e.facingRight[m] = f;
+		e.xform[m] = Xform(e.x[m], e.y[m], e.sx[m], e.sy[m], f != 0);
+	}
+}
+
+#ifdef SWIM_SSE2
+__m128 Select(__m128 mask, __m128 a, __m128 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+#endif
+
+} // end namespace
+
+mat4 PtTransform(const Affine2 &m) {
+	return mat4(vec4(m.a, m.b, 0, m.tx), vec4(m.c, m.d, 0, m.ty), vec4(0, 0, 1, 0), vec4(0, 0, 0, 1));
+}
+
+// Entities
+
+int Entities::Create(EntityKind k, vec2 p, vec2 v, vec2 scale, int nf, float fd) {
+	int n = nextId++;
+	indices[n] = Size();
+	id.push_back(n);
+	kind.push_back((unsigned char) k);
+	motion.push_back(v.x != 0 || v.y != 0? PATROL : STILL);
+	facingRight.push_back(v.x >= 0);
+	x.push_back(p.x); y.push_back(p.y);
+	px.push_back(p.x); py.push_back(p.y);
+	vx.push_back(v.x); vy.push_back(v.y);
+	wx.push_back(v.x); wy.push_back(v.y);
+	sx.push_back(scale.x); sy.push_back(scale.y);
+	xform.push_back(Xform(p.x, p.y, scale.x, scale.y, v.x >= 0));
+	frameTime.push_back(0);
+	frameDuration.push_back(fd);
+	frame.push_back(0);
+	nFrames.push_back(nf);
+	sprite.push_back(NULL);
+	return n;
+}
+
+void Entities::Destroy(int n) {
+	auto f = indices.find(n);
+	if (f == indices.end())
+		return;
+	int i = f->second, last = Size()-1;
+	indices.erase(f);
+	if (i != last) {
+		// move last entity into the hole
+		id[i] = id[last];
+		kind[i] = kind[last]; motion[i] = motion[last]; facingRight[i] = facingRight[last];
+		x[i] = x[last]; y[i] = y[last];
+		px[i] = px[last]; py[i] = py[last];
+		vx[i] = vx[last]; vy[i] = vy[last];
+		wx[i] = wx[last]; wy[i] = wy[last];
+		sx[i] = sx[last]; sy[i] = sy[last];
+		xform[i] = xform[last];
+		frameTime[i] = frameTime[last]; frameDuration[i] = frameDuration[last];
+		frame[i] = frame[last]; nFrames[i] = nFrames[last];
+		sprite[i] = sprite[last];
+		indices[id[i]] = i;
+	}
+	id.pop_back();
+	kind.pop_back(); motion.pop_back(); facingRight.pop_back();
+	x.pop_back(); y.pop_back();
+	px.pop_back(); py.pop_back();
+	vx.pop_back(); vy.pop_back();
+	wx.pop_back(); wy.pop_back();
+	sx.pop_back(); sy.pop_back();
+	xform.pop_back();
+	frameTime.pop_back(); frameDuration.pop_back();
+	frame.pop_back(); nFrames.pop_back();
+	sprite.pop_back();
+}
+
+int Entities::Index(int n) {
+	auto f = indices.find(n);
+	return f == indices.end()? -1 : f->second;
+}
+
+int Entities::First(EntityKind k) {
+	int first = 0;
+	for (int i = 0; i < Size(); i++)
+		if (kind[i] == k && (!first || id[i] < first))
+			first = id[i];
+	return first;
+}
+
+int Entities::Count(EntityKind k) {
+	int count = 0;
+	for (unsigned char c : kind)
+		count += c == k;
+	return count;
+}
+
+int Entities::Find(Sprite *s) {
+	for (int i = 0; i < Size(); i++)
+		if (sprite[i] == s)
+			return id[i];
+	return 0;
+}
+
+void Entities::SetSprite(int n, Sprite *s) {
+	int i = Index(n);
+	if (i >= 0)
+		sprite[i] = s;
+}
+
+Affine2 Entities::Transform(int i, float alpha) {
+	Affine2 m = xform[i];
+	vec2 p = Interpolate(i, alpha);
+	m.tx = p.x;
+	m.ty = p.y;
+	return m;
+}
+
+void Entities::Clear() {
+	while (Size())
+		Destroy(id.back());
+}
+
+// Systems
+
+void SavePositions(Entities &e) {
+	e.px = e.x;
+	e.py = e.y;
+}
+
+void Swim(Entities &e, float dt, float maxX, float maxY, vector<int> &turns) {
+	int n = e.Size(), i = 0;
+	float *x = e.x.data(), *y = e.y.data(), *vx = e.vx.data(), *vy = e.vy.data();
+	const unsigned char *motion = e.motion.data();
+#if defined(__AVX2__)
+	const __m256 vdt = _mm256_set1_ps(dt), vmaxX = _mm256_set1_ps(maxX), vmaxY = _mm256_set1_ps(maxY);
+	const __m256 sign = _mm256_set1_ps(-0.f), zero = _mm256_setzero_ps();
+	const __m256i patrol = _mm256_set1_epi32(PATROL), still = _mm256_setzero_si256();
+	for (; i+8 <= n; i += 8) {
+		__m256i m = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (motion+i)));
+		__m256 moving = _mm256_castsi256_ps(_mm256_cmpgt_epi32(m, still));
+		__m256 patrolling = _mm256_castsi256_ps(_mm256_cmpeq_epi32(m, patrol));
+		__m256 X = _mm256_loadu_ps(x+i), Y = _mm256_loadu_ps(y+i);
+		__m256 VX = _mm256_loadu_ps(vx+i), VY = _mm256_loadu_ps(vy+i);
+		X = _mm256_add_ps(X, _mm256_and_ps(moving, _mm256_mul_ps(vdt, VX)));
+		Y = _mm256_add_ps(Y, _mm256_and_ps(moving, _mm256_mul_ps(vdt, VY)));
+		// where patrolling and |p| >= max, point velocity away from the wall (sign bit
+		// opposite p's) and clamp p to it, so one outside the bounds doesn't flip each step
+		__m256 hitX = _mm256_and_ps(patrolling, _mm256_cmp_ps(_mm256_andnot_ps(sign, X), vmaxX, _CMP_GE_OQ));
+		__m256 hitY = _mm256_and_ps(patrolling, _mm256_cmp_ps(_mm256_andnot_ps(sign, Y), vmaxY, _CMP_GE_OQ));
+		VX = _mm256_blendv_ps(VX, _mm256_or_ps(_mm256_andnot_ps(sign, VX), _mm256_andnot_ps(X, sign)), hitX);
+		VY = _mm256_blendv_ps(VY, _mm256_or_ps(_mm256_andnot_ps(sign, VY), _mm256_andnot_ps(Y, sign)), hitY);
+		X = _mm256_blendv_ps(X, _mm256_min_ps(_mm256_max_ps(X, _mm256_xor_ps(vmaxX, sign)), vmaxX), hitX);
+		Y = _mm256_blendv_ps(Y, _mm256_min_ps(_mm256_max_ps(Y, _mm256_xor_ps(vmaxY, sign)), vmaxY), hitY);
+		_mm256_storeu_ps(x+i, X); _mm256_storeu_ps(y+i, Y);
+		_mm256_storeu_ps(vx+i, VX); _mm256_storeu_ps(vy+i, VY);
+		Finish(e, i, 8, _mm256_movemask_ps(_mm256_cmp_ps(VX, zero, _CMP_GT_OQ)), _mm256_movemask_ps(_mm256_cmp_ps(VX, zero, _CMP_LT_OQ)), turns);
+	}
+#elif defined(SWIM_SSE2)
+	const __m128 vdt = _mm_set1_ps(dt), vmaxX = _mm_set1_ps(maxX), vmaxY = _mm_set1_ps(maxY);
+	const __m128 sign = _mm_set1_ps(-0.f), zero = _mm_setzero_ps();
+	const __m128i patrol = _mm_set1_epi32(PATROL), still = _mm_setzero_si128();
+	for (; i+4 <= n; i += 4) {
+		int bytes;
+		memcpy(&bytes, motion+i, 4);
+		__m128i m = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), still), still);
+		__m128 moving = _mm_castsi128_ps(_mm_cmpgt_epi32(m, still));
+		__m128 patrolling = _mm_castsi128_ps(_mm_cmpeq_epi32(m, patrol));
+		__m128 X = _mm_loadu_ps(x+i), Y = _mm_loadu_ps(y+i);
+		__m128 VX = _mm_loadu_ps(vx+i), VY = _mm_loadu_ps(vy+i);
+		X = _mm_add_ps(X, _mm_and_ps(moving, _mm_mul_ps(vdt, VX)));
+		Y = _mm_add_ps(Y, _mm_and_ps(moving, _mm_mul_ps(vdt, VY)));
+		__m128 hitX = _mm_and_ps(patrolling, _mm_cmpge_ps(_mm_andnot_ps(sign, X), vmaxX));
+		__m128 hitY = _mm_and_ps(patrolling, _mm_cmpge_ps(_mm_andnot_ps(sign, Y), vmaxY));
+		VX = Select(hitX, _mm_or_ps(_mm_andnot_ps(sign, VX), _mm_andnot_ps(X, sign)), VX);
+		VY = Select(hitY, _mm_or_ps(_mm_andnot_ps(sign, VY), _mm_andnot_ps(Y, sign)), VY);
+		X = Select(hitX, _mm_min_ps(_mm_max_ps(X, _mm_xor_ps(vmaxX, sign)), vmaxX), X);
+		Y = Select(hitY, _mm_min_ps(_mm_max_ps(Y, _mm_xor_ps(vmaxY, sign)), vmaxY), Y);
+		_mm_storeu_ps(x+i, X); _mm_storeu_ps(y+i, Y);
+		_mm_storeu_ps(vx+i, VX); _mm_storeu_ps(vy+i, VY);
+		Finish(e, i, 4, _mm_movemask_ps(_mm_cmpgt_ps(VX, zero)), _mm_movemask_ps(_mm_cmplt_ps(VX, zero)), turns);
+	}
+#endif
+	// scalar, for the remainder (or all, without SIMD)
+	for (; i < n; i++) {
+		if (motion[i] != STILL) {
+			x[i] += dt*vx[i];
+			y[i] += dt*vy[i];
+		}
+		if (motion[i] == PATROL) {
+			// turn away from the wall (not merely reverse), and back inside
+			if (fabs(y[i]) >= maxY) {
+				vy[i] = -copysignf(fabsf(vy[i]), y[i]);
+				y[i] = y[i] > 0? maxY : -maxY;
+			}
+			if (fabs(x[i]) >= maxX) {
+				vx[i] = -copysignf(fabsf(vx[i]), x[i]);
+				x[i] = x[i] > 0? maxX : -maxX;
+			}
+		}
+		Finish(e, i, 1, vx[i] > 0, vx[i] < 0, turns);
+	}
+}
+
+void Animate(Entities &e, float dt) {
+	for (int i = 0, n = e.Size(); i < n; i++)
+		if (e.nFrames[i] > 1 && (e.frameTime[i] += dt) >= e.frameDuration[i]) {
+			e.frameTime[i] -= e.frameDuration[i];
+			e.frame[i] = (e.frame[i]+1)%e.nFrames[i];
+		}
+}
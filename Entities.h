@@ -0,0 +1,85 @@
+// Entities.h - structure-of-arrays storage for tank creatures and items
+
+#ifndef ENTITIES_HDR
+#define ENTITIES_HDR
+
+#include <unordered_map>
+#include <vector>
+#include "VecMat.h"
+
+using std::vector;
+
+// each component is an array with one element per live entity, so systems
+// (free functions below) stream over contiguous floats rather than objects;
+// destroying an entity moves the last one into its slot, so indices change
+// but ids (increasing with creation) are stable
+
+class Sprite;
+
+enum EntityKind { KIND_FISH = 0, KIND_SNAIL, KIND_REDFISH, KIND_GOLDFISH, KIND_PELLET, KIND_MESS };
+
+enum Motion { STILL = 0, PATROL, SEEK, FLOCK };
+	// PATROL: move with velocity, turn at tank walls; SEEK: move with velocity, no turns;
+	// FLOCK: as SEEK, velocity steered by a Flock
+
+struct Affine2 {
+	// rows of a 2D affine transform: (a*x+b*y+tx, c*x+d*y+ty)
+	float a = 1, b = 0, tx = 0, c = 0, d = 1, ty = 0;
+};
+
+mat4 PtTransform(const Affine2 &m);
+	// as a sprite ptTransform (z unchanged)
+
+class Entities {
+public:
+	// components
+	vector<int> id;
+	vector<unsigned char> kind, motion, facingRight;
+	vector<float> x, y;				// NDC position
+	vector<float> px, py;			// position before the last step, for interpolation
+	vector<float> vx, vy;			// NDC per second
+	vector<float> wx, wy;			// velocity to resume after seeking
+	vector<float> sx, sy;			// scale of the unit quad
+	vector<Affine2> xform;			// translate(x, y)*scale(facingRight? sx : -sx, sy), set by Swim
+	vector<float> frameTime, frameDuration;
+	vector<int> frame, nFrames;		// animation state
+	vector<Sprite *> sprite;		// display, if any (unused by systems)
+	// entities
+	int Create(EntityKind k, vec2 p, vec2 v = vec2(0.f, 0.f), vec2 scale = vec2(1.f, 1.f), int nFrames = 1, float frameDuration = 0);
+		// return id
+	void Destroy(int id);
+	int Index(int id);
+		// return -1 if no such entity
+	int First(EntityKind k);
+		// id of oldest entity of kind k, 0 if none
+	int Count(EntityKind k);
+	int Find(Sprite *s);
+		// id of entity displayed by s, 0 if none
+	void SetSprite(int id, Sprite *s);
+	int Size() { return (int) id.size(); }
+	vec2 Position(int i) { return vec2(x[i], y[i]); }
+	vec2 Interpolate(int i, float alpha) { return vec2(px[i]+alpha*(x[i]-px[i]), py[i]+alpha*(y[i]-py[i])); }
+	Affine2 Transform(int i, float alpha);
+		// xform[i], translated to the interpolated position
+	void Clear();
+private:
+	int nextId = 1;
+	std::unordered_map<int, int> indices;
+};
+
+// systems
+
+void SavePositions(Entities &e);
+	// px, py = x, y
+
+void Swim(Entities &e, float dt, float maxX, float maxY, vector<int> &turns);
+	// advance all but STILL entities by velocity, turn PATROL velocity inward at the
+	// tank walls (|x| >= maxX, |y| >= maxY) and clamp position to them, set facingRight
+	// from the sign of non-zero vx, and set xform; append to turns the indices of
+	// entities whose facing changed;
+	// eight (AVX2) or four (SSE2) entities at a time, if compiled for them
+
+void Animate(Entities &e, float dt);
+	// advance frames of multi-frame entities
+
+#endif
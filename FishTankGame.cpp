@@ -5,10 +5,22 @@
 #include <glad.h>
 #include <GLFW/glfw3.h>
 #include "Draw.h"
+#include "GLState.h"
 #include "GLXtras.h"
+#include "AlphaMask.h"
+#include "AssetLoader.h"
+#include "Atlas.h"
+#include "Capture.h"
+#include "Recorder.h"
+#include "SpatialHash.h"
 #include "Sprite.h"
+#include "SpriteBatch.h"
+#include "TankSimulation.h"
+#include "TextureCache.h"
+#include "TexturePack.h"
 #include <algorithm>
-#include <time.h>
+#include <chrono>
+#include <string.h>
 #include "Text.h"
 #include <iostream>
 #include <string>
@@ -27,7 +39,9 @@ Sprite background, fish,
 	&foodButton, &xButton, &boat, &chest, &volcano, &snail, &upgrade, &goldfish, &redfish, &displaySnail,
 	&displaySnail, &displayGoldfish, &displayRedfish, }, * selected = NULL;
 
-double money = 0; // game currency
+SpriteBatch spriteBatch; // collects sprites each frame for instanced display
+
+TankSimulation tank; // money, swimming and spawning, stepped at a fixed rate
 
 // values for text
 int winWidth = 1920, winHeight = 1080;
@@ -35,9 +49,13 @@ vec3 org(1, 1, 1);
 
 // booleans to change background and what is visible
 bool startGame = false;
-bool feedingTime = false;
 bool displayShop = false;
 
+// frame capture, for QA
+bool screenshot = false, capturing = false;
+int nCaptured = 0;
+string captureDir = "";	// with trailing slash, if set (-captures); else the working directory
+
 // shop booleans
 bool buyBoat = false;
 bool buyChest = false;
@@ -51,7 +69,6 @@ int boatCost = 30, chestCost = 40, volcanoCost = 50, snailCost = 20, upgradeCost
 
 // values for tank capacity
 int numUpgrades = 0;
-int numFish = 1;
 int capacity = 1;
 
 enum ItemType { // shop's buy button index values
@@ -68,22 +85,11 @@ enum ItemType { // shop's buy button index values
 vector<Sprite>buyButtonsVec;
 vec2 buyButtonPositions[] = { {-1.2f, -0.7f}, {0.0f, -0.7f}, {0.9f, -0.7f }, { -1.2f, 0.1f }, {-0.4f, 0.1f}, {0.5f, 0.1f}, {1.2f, 0.1f} };
 
-// vector of messes to be spawned in
-vector<Sprite>messVec;
+// messes and pellets are tank entities, each displayed by its own sprite
 float messZ = -0.05f; // will vary from -0.05f to -0.4f for unique clicks
 
-vector<Sprite>pelletsVec;
-
-// sensor locations (wrt fish sprite)
-vec2 fishSensors[] = { {-.45f, .0f}, {.5f, -.4f}, {.45f, .4f}, {.85f, .0f}, {-.05f, .65f}, {-.3f, -.35f}, {-.4f, .5f}, {-.05f, -.8f} };
-const int nFishSensors = sizeof(fishSensors) / sizeof(vec2);
-vec3 fishProbes[nFishSensors];
-
-
-// booleans to fix fish flipping
-bool hitWall = false;
-bool needToFlip = false;
-bool direction = true; // True is right, false is left
+// broadphase for clicks on messes and pellets (fish find pellets in TankSimulation)
+SpatialHash messHash, pelletHash;
 
 
 // initialize function for many sprites
@@ -92,6 +98,8 @@ void gameInitialize() {
 	fish.Initialize(a, "", -1.f, 0.25);
 	fish.SetScale(vec2(.3f, .3f));
 	fish.SetFrame(0);
+	fish.autoAnimate = false; // frames advance with the tank simulation
+	tank.entities.SetSprite(tank.entities.First(KIND_FISH), &fish);
 
 	shopButton.Initialize("C:/Assets/Images/shopbutton.png", -.98f, false);
 	shopButton.SetScale(vec2(.1f, .1f));
@@ -154,10 +162,6 @@ void gameInitialize() {
 	goldfish.SetFrame(0);
 	goldfish.autoAnimate = false;
 
-	// goldfish starts going left
-	goldfish.uvTransform = goldfish.uvTransform * Scale(-1, 1, 1);
-	goldfish.ptTransform = goldfish.ptTransform * Scale(-1, 1, 1);
-
 	vector<string> h{ "C:/Assets/Images/red_fish_2.png", "C:/Assets/Images/red_fish_3.png" };
 	redfish.Initialize(h, "", -1.f, 0.5);
 	redfish.SetScale(vec2(.4f, .4f));
@@ -172,15 +176,14 @@ void gameInitialize() {
 
 }
 
-void spawnMess() {
-	Sprite mess;
-	mess.Initialize("C:/Assets/Images/Algae.png", messZ, false);
-	mess.SetScale(vec2(.3f, .3f));
-	float xSpawn = -1.f + (float)(rand()) / RAND_MAX * (1.f - (-1.f)); // calculating random spot on screen
-	float ySpawn = -1.f + (float)(rand()) / RAND_MAX * (1.f - (-1.f));
-	mess.SetPosition(vec2(xSpawn, ySpawn));
+void spawnMess(TankSimulation &t, int id) { // tank spawned a mess at a random spot, give it a sprite
+	Sprite *mess = new Sprite;
+	mess->Initialize("C:/Assets/Images/Algae.png", messZ, false);
+	mess->SetScale(vec2(.3f, .3f));
+	mess->SetPosition(t.entities.Position(t.entities.Index(id)));
+	t.entities.SetSprite(id, mess);
 
-	messVec.push_back(mess);
+	messHash.Add(mess);
 	messZ -= 0.02f;
 
 	if (messZ <= -0.4f) // not enough z values, need to stay within a range
@@ -188,109 +191,124 @@ void spawnMess() {
 }
 
 void spawnPellet(float x, float y) {
-	Sprite pellet;
-	pellet.Initialize("C:/Assets/Images/fishpellet.png", -0.85f, false);
-	pellet.SetScale(vec2(0.025f, 0.025f));
-	pellet.SetScreenPosition(x, y);
+	Sprite *pellet = new Sprite;
+	pellet->Initialize("C:/Assets/Images/fishpellet.png", -0.85f, false);
+	pellet->SetScale(vec2(0.025f, 0.025f));
+	pellet->SetScreenPosition(x, y);
+	tank.entities.SetSprite(tank.DropPellet(pellet->position), pellet);
 
-	pelletsVec.push_back(pellet);
+	pelletHash.Add(pellet);
 }
 
+void removeSprite(TankSimulation &t, int id) { // tank is dropping a pellet or mess: release its sprite (which leaves its hash)
+	Sprite *s = t.entities.sprite[t.entities.Index(id)];
+	if (s) {
+		s->Release();
+		delete s;
+	}
+}
 
-// Display
-
-vec3 Probe(vec2 ndc) {
-	// ndc (normalized device coords) lower left (-1,-1) to upper right (1,1)
-	// return screen-space s: s.z is depth-buffer value at pixel (s.x, s.y)
-	int4 vp = VP();
-	vec3 s(vp[0] + (ndc.x + 1) * vp[2] / 2, vp[1] + (ndc.y + 1) * vp[3] / 2, 0);
-	DepthXY((int)s.x, (int)s.y, s.z);
-	return s;
+bool fishEats(TankSimulation &t, int f, int pellet) { // exact test of fish quad against pellet quad
+	Sprite *fs = t.entities.sprite[f], *ps = t.entities.sprite[pellet];
+	if (!fs || !ps)
+		return true;
+	fs->ptTransform = PtTransform(t.entities.xform[f]);
+	return fs->Intersect(*ps);
 }
 
-vec3 Probe(vec2 v, mat4 m) {
-	// promote v to 4D with arbitrary z and w = 1, transform by m
-	return Probe(Vec2(m * vec4(v, 0, 1)));
+void showTank(float alpha) { // display creatures between the last two steps, mirrored if swimming left (images face right)
+	Entities &e = tank.entities;
+	for (int i = 0; i < e.Size(); i++) {
+		Sprite *s = e.sprite[i];
+		if (!s || e.kind[i] == KIND_PELLET || e.kind[i] == KIND_MESS)
+			continue;
+		s->position = e.Interpolate(i, alpha);
+		s->ptTransform = PtTransform(e.Transform(i, alpha)); // the tank's 2D affine, not Translate*RotateZ*Scale
+		if (s->frame != e.frame[i])
+			s->SetFrame(e.frame[i]);
+	}
 }
 
+
+// Display
+
 void textDisplay() { // function to display both the money and the fish capacity
 	float fontSize = 36;
-	string moneyText = to_string(money);
+	string moneyText = to_string(tank.money);
 	const char* moneycstr = moneyText.c_str();
 	int wMoney = TextWidth(fontSize, moneycstr);
 
 	vec2 s1(winWidth - wMoney + 150, winHeight - 150);
 
-	string capacityText = to_string(numFish) + " / " + to_string(capacity) + " Capacity";
+	string capacityText = to_string(tank.numFish) + " / " + to_string(capacity) + " Capacity";
 	const char* capacitycstr = capacityText.c_str();
 
 	vec2 s2(0, winHeight - 150);
 
-	glDisable(GL_DEPTH_TEST);
+	Disable(GL_DEPTH_TEST);
+	BeginText();
 	Text(s1.x, s1.y, org, fontSize, moneycstr);
 	Text(s2.x, s2.y, org, fontSize, capacitycstr);
-	glEnable(GL_DEPTH_TEST);
+	EndText(); // both lines in one draw
+	Enable(GL_DEPTH_TEST);
 }
 
 void displayBoughtStuff() { // checks through bought booleans to determine whether to display on home screen
 	if (buyBoat) {
 		boat.SetScale(vec2(.3f, .3f));
 		boat.SetPosition(vec2(0.7f, -0.4f));
-		boat.Display();
+		spriteBatch.Add(boat);
 	}
 
 	if (buyChest) {
 		chest.SetScale(vec2(.2f, .2f));
 		chest.SetPosition(vec2(-.6f, -0.5f));
-		chest.Display();
+		spriteBatch.Add(chest);
 	}
 
 	if (buyVolcano) {
 		volcano.SetScale(vec2(.4f, .4f));
 		volcano.SetPosition(vec2(0.5f, -0.4f));
 		volcano.autoAnimate = true;
-		volcano.Display();
+		spriteBatch.Add(volcano);
 	}
 
 	if (buySnail) {
-		snail.autoAnimate = true;
-		snail.Display();
+		spriteBatch.Add(snail);
 	}
 
 	if (buyGoldfish) {
-		goldfish.autoAnimate = true;
-		goldfish.Display();
+		spriteBatch.Add(goldfish);
 	}
 
 	if (buyRedfish) {
-		redfish.autoAnimate = true;
-		redfish.Display();
+		spriteBatch.Add(redfish);
 	}
 }
 
 void displayShopStuff() { // shows things available in shop screen
-	xButton.Display(); // button to close shop
+	spriteBatch.Add(xButton); // button to close shop
 
 
 	// setting position and scale since it is different in home screen
 
 	boat.SetScale(vec2(.3f, .3f)); 
 	boat.SetPosition(vec2(-0.7f, -0.2f));
-	boat.Display();
+	spriteBatch.Add(boat);
 
 
 	chest.SetScale(vec2(.2f, .2f));
 	chest.SetPosition(vec2(0.0f, -0.3f));
-	chest.Display();
+	spriteBatch.Add(chest);
 
 
 	volcano.SetScale(vec2(.3f, .3f));
 	volcano.SetPosition(vec2(.8f, -0.2f));
 	volcano.autoAnimate = false;
-	volcano.Display();
+	spriteBatch.Add(volcano);
 
 
-	upgrade.Display();
+	spriteBatch.Add(upgrade);
 
 	// sprite to display the snail, goldfish, and redfish as a still placeholder, since these move
 
@@ -299,19 +317,19 @@ void displayShopStuff() { // shows things available in shop screen
 	displaySnail.SetPosition(vec2(-0.7f, 0.4f));
 
 
-	displaySnail.Display();
+	spriteBatch.Add(displaySnail);
 	
 	displayRedfish.SetScale(vec2(.2f, .2f));
 	displayRedfish.SetPosition(vec2(0.3f, 0.4f));
 
 
-	displayRedfish.Display();
+	spriteBatch.Add(displayRedfish);
 	
 	displayGoldfish.SetScale(vec2(.2f, .2f));
 	displayGoldfish.SetPosition(vec2(.7f, 0.4f));
 
 
-	displayGoldfish.Display();
+	spriteBatch.Add(displayGoldfish);
 
 	// display prices
 
@@ -339,7 +357,10 @@ void displayShopStuff() { // shows things available in shop screen
 	const char* redfishcstr = redfishStr.c_str();
 	
 
-	glDisable(GL_DEPTH_TEST);
+	spriteBatch.Display(); // shop items before prices
+
+	Disable(GL_DEPTH_TEST);
+	BeginText();
 	Text(100, 150, org, fontSize, boatcstr);
 	Text(800, 150, org, fontSize, chestcstr);
 	Text(1300, 150, org, fontSize, volcanocstr);
@@ -347,20 +368,22 @@ void displayShopStuff() { // shows things available in shop screen
 	Text(550, 550, org, fontSize, upgradecstr);
 	Text(1100, 550, org, fontSize, goldfishcstr);
 	Text(1500, 550, org, fontSize, redfishcstr);
-	glEnable(GL_DEPTH_TEST);
+	EndText(); // all prices in one draw
+	Enable(GL_DEPTH_TEST);
 
 	for (Sprite& button : buyButtonsVec) {
-		button.Display();
+		spriteBatch.Add(button);
 
 	}
+	spriteBatch.Display();
 }
 
 
 void Display() {
 	vec3 red(1, 0, 0), grn(0, .7f, 0), yel(1, 1, 0);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glEnable(GL_DEPTH_TEST);
+	Enable(GL_BLEND);
+	BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	Enable(GL_DEPTH_TEST);
 	glClear(GL_DEPTH_BUFFER_BIT);
 
 
@@ -371,39 +394,23 @@ void Display() {
 		playButton.Display();
 	}
 
-	for (int i = 0; i < nFishSensors; i++)
-		fishProbes[i] = Probe(fishSensors[i], fish.ptTransform);
-
-	// code to flip fish if it bumps into wall
-	if (hitWall || needToFlip) {
-		fish.uvTransform = fish.uvTransform * Scale(-1, 1, 1);
-		fish.ptTransform = fish.ptTransform * Scale(-1, 1, 1);
-		hitWall = false;
-		needToFlip = false;
-		direction = !direction;
-
-		for (vec2& probe : fishSensors) probe.x *= -1;
-	}
-
 	if (startGame && !displayShop) { // home screen
 
 		textDisplay(); // shows capacity and money
-		fish.Display();
-		shopButton.Display();
-		foodButton.Display();
+		spriteBatch.Add(fish);
+		spriteBatch.Add(shopButton);
+		spriteBatch.Add(foodButton);
 
 		displayBoughtStuff(); // shows bought items in home screen
 		
 
-		if (feedingTime) {
-			for (Sprite &s : pelletsVec) {
-				s.Display();
-			}
+		Entities &e = tank.entities;
+		for (int i = 0; i < e.Size(); i++) { // pellets and algae displaying on screen
+			if (e.sprite[i] && (e.kind[i] == KIND_MESS || (e.kind[i] == KIND_PELLET && tank.feeding)))
+				spriteBatch.Add(*e.sprite[i]);
 		}
 
-		for (Sprite& messes : messVec) { // algae displaying on screen
-			messes.Display();
-		}
+		spriteBatch.Display(); // one instanced draw per texture
 	}
 
 	if (displayShop) {
@@ -412,36 +419,35 @@ void Display() {
 	}
 
 
-	glDisable(GL_DEPTH_TEST);
-	glEnable(GL_DEPTH_TEST); // need z-buffer for mouse hit-test
+	Disable(GL_DEPTH_TEST);
+	Enable(GL_DEPTH_TEST); // need z-buffer for mouse hit-test
 	glFlush();
 }
 
-bool fishEating() {
-	for (int i = 0; i < nFishSensors; i++) {
-		if (fishProbes[i].z < -0.01f) {
-			return true;
-		}
-	}
-	return false;
-}
-
-float snailX = 0.001f; //snail move speed
-
-void snailMove() { // snail moves horizontally
-	snail.SetPosition(snail.position + vec2(snailX, 0.0f));
+void setup() {
+	// pack the sprite images into atlas pages before any sprite reads them (backgrounds are too big)
+	vector<string> atlasImages;
+	for (const char *name : { "playbutton", "fishleft", "fishright", "shopbutton", "foodbutton", "foodbuttonpressed", "x",
+							  "boat", "buybutton", "checkmark", "Chest", "volcano_1", "volcano_2", "aquariumPlus",
+							  "gary_1", "gary_2", "goldfish", "gold_fish_3", "red_fish_2", "red_fish_3", "Algae", "fishpellet" })
+		atlasImages.push_back(string("C:/Assets/Images/") + name + ".png");
+	vector<string> b{ "C:/Assets/Images/titlescreen.png", "C:/Assets/Images/fishbackground.png", "C:/Assets/Images/shopmenu.png" };
 
-	if (snail.position.x >= 1.45f || snail.position.x <= -1.45f) { // flip sprite when reaching ends of tank
-		snailX *= -1;
-		snail.uvTransform = snail.uvTransform * Scale(-1, 1, 1);
-		snail.ptTransform = snail.ptTransform * Scale(-1, 1, 1);
+	// decoded images, with mipmaps and hit masks, come from the pack, rewritten if missing,
+	// damaged, or out of date with any image; images too big for the atlas (the backgrounds)
+	// are block-compressed
+	const char *pack = "C:/Assets/Images/images.pack";
+	vector<string> all(atlasImages);
+	all.insert(all.end(), b.begin(), b.end());
+	if (!OpenTexturePack(pack) || !TexturePackCurrent(all)) {
+		if (WriteTexturePack(pack, all, 1024))
+			OpenTexturePack(pack);
 	}
+	BuildAtlas(atlasImages);
 
-}
-
-void setup() {
-	vector<string> b{ "C:/Assets/Images/titlescreen.png", "C:/Assets/Images/fishbackground.png", "C:/Assets/Images/shopmenu.png" };
+	SetAsyncTextures(true); // too big for the atlas; if not in the pack, stream them in rather than stall startup
 	background.Initialize(b, "", 0, false);
+	SetAsyncTextures(false);
 	background.SetScale(vec2(2.f, 1.f));
 	background.autoAnimate = false;
 	background.SetFrame(0);
@@ -457,187 +463,138 @@ void setup() {
 
 }
 
-float redfishDx = 0.003f;
-
-void redfishMove() {
-	redfish.SetPosition(redfish.position + vec2(redfishDx, 0.0f));
+// Mouse
 
-	if (redfish.position.x >= 1.45f || redfish.position.x <= -1.45f) { // flip sprite when reaching ends of tank
-		redfishDx *= -1;
-		redfish.uvTransform = redfish.uvTransform * Scale(-1, 1, 1);
-		redfish.ptTransform = redfish.ptTransform * Scale(-1, 1, 1);
+void VisibleSprites(vector<Sprite *> &v) {
+	// sprites displayed on the current screen
+	v = { &background };
+	if (!startGame)
+		v.push_back(&playButton);
+	else if (displayShop) {
+		for (Sprite *s : { &xButton, &boat, &chest, &volcano, &upgrade, &displaySnail, &displayRedfish, &displayGoldfish })
+			v.push_back(s);
+		for (Sprite &b : buyButtonsVec)
+			v.push_back(&b);
 	}
-}
-
-float goldfishDx = -0.002f;
-
-void goldfishMove() {
-	goldfish.SetPosition(goldfish.position + vec2(goldfishDx, 0.0f));
-
-	if (goldfish.position.x >= 1.45f || goldfish.position.x <= -1.45f) { // flip sprite when reaching ends of tank
-		goldfishDx *= -1;
-		goldfish.uvTransform = goldfish.uvTransform * Scale(-1, 1, 1);
-		goldfish.ptTransform = goldfish.ptTransform * Scale(-1, 1, 1);
+	else {
+		for (Sprite *s : { &fish, &shopButton, &foodButton })
+			v.push_back(s);
+		if (buyBoat) v.push_back(&boat);
+		if (buyChest) v.push_back(&chest);
+		if (buyVolcano) v.push_back(&volcano);
+		if (buySnail) v.push_back(&snail);
+		if (buyGoldfish) v.push_back(&goldfish);
+		if (buyRedfish) v.push_back(&redfish);
+		// pellets and messes come from their hashes, see FrontZ
 	}
 }
 
-
-float dx = 0.005f, dy = 0.005f;
-
-// variables for fish finding pellets
-bool locateFood = true;
-float hypotenuse = 0.0f;
-vec2 unitVectors = {};
-const float swimSpeed = 0.005f;
-vec2 swimToFood = {};
-vec2 distanceToPellet = {};
-
-void fishMove() {
-	if (feedingTime) { // check if food button has been pressed
-		if (!pelletsVec.empty()) {
-
-			vec2 pelletPosition = pelletsVec[0].GetScreenPosition(); // get the lru pellet 
-
-
-
-			if (locateFood) { // a pellet has been detected
-				distanceToPellet = pelletPosition - fish.GetScreenPosition();
-
-				// flips for direction changes from previous movement
-				if (distanceToPellet.x < 0 && direction) {
-					needToFlip = true;
-				}
-
-				if (distanceToPellet.x > 0 && !direction) {
-					needToFlip = true;
-				}
-
-				// calculate the unit vector for straight line traversal
-				hypotenuse = sqrt((distanceToPellet.x * distanceToPellet.x) + (distanceToPellet.y * distanceToPellet.y));
-
-				unitVectors = { distanceToPellet.x / hypotenuse, distanceToPellet.y / hypotenuse };
-
-				// multiply unit vector by fish swim speed to get straight line movement at desired pace
-				swimToFood = { unitVectors.x * swimSpeed, unitVectors.y * swimSpeed };
-
-				// set boolean to false so previous values do not update until pellet found
-				locateFood = false;
-			}
-
-			if (fishEating() || fish.Intersect(pelletsVec[0])) {
-
-				pelletsVec.erase(pelletsVec.begin()); // clear the eaten pellet
-				locateFood = true;
-				money += 0.1;
-
-				if (dx < 0.0f && direction) needToFlip = true;
-				if (dx > 0.0f && !direction) needToFlip = true;
-
-			}
-
-			fish.SetPosition(fish.position + swimToFood);
-		}
-	}
-	else {
-		if (dx < 0 && direction) {
-			needToFlip = true;
-		}
-
-		if (dx > 0 && !direction) {
-			needToFlip = true;
-		}
-
-		fish.SetPosition(fish.position + vec2(dx, dy)); // fish moves in dvd pattern
-
-		if (fish.position.y >= 0.8f || fish.position.y <= -0.8f) // if fish reaches top or bottom of tank
-			dy *= -1;
-
-		// if fish reaches left or right edge of tank
-		if (fish.position.x >= 1.45f || fish.position.x <= -1.45f) {
-			dx *= -1;
-			hitWall = true;
+float FrontZ(float x, float y) {
+	// z of the front-most displayed sprite at (x, y), as the z-buffer would hold (1 if none)
+	vector<Sprite *> v;
+	VisibleSprites(v);
+	if (startGame && !displayShop) {
+		vector<Sprite *> near;
+		vec2 ndc = NDCfromScreen(x, y);
+		messHash.QueryPoint(ndc, near);
+		v.insert(v.end(), near.begin(), near.end());
+		if (tank.feeding) {
+			pelletHash.QueryPoint(ndc, near);
+			v.insert(v.end(), near.begin(), near.end());
 		}
 	}
+	float z = 1;
+	for (Sprite *s : v)
+		if (s->z < z && s->Hit(x, y))
+			z = s->z;
+	return z;
 }
 
-// Mouse
-
-
+bool FrontHit(Sprite &s, float x, float y, float frontZ) {
+	// s is loaded, hit and not hidden by another sprite
+	return fabs(s.z - frontZ) < .01f && s.Ready() && s.Hit(x, y);
+}
 
 void MouseButton(float x, float y, bool left, bool down) {
 	if (left && down) {
 		selected = NULL;
-		if (playButton.Hit(x, y)) { // start game, change background and initialize sprites
+		// screen and occlusion as displayed, before this click changes them
+		bool home = startGame && !displayShop, shop = startGame && displayShop;
+		float frontZ = FrontZ(x, y);
+		if (!startGame && FrontHit(playButton, x, y, frontZ)) { // start game, change background and initialize sprites
 			background.SetFrame(1);
 			startGame = true;
+			SetAsyncTextures(true); // show the tank now, sprites as their images arrive
 			gameInitialize();
+			SetAsyncTextures(false);
 			playButton.Release();
 
 			wav.Play(volume); // play music!
 			wav.Loop(volume, -1);
 		}
 		else if (startGame) { // if game has started check for the rest
-			if (foodButton.Hit(x, y)) { // time to feed the fishies
-				if (!feedingTime) {
-					feedingTime = true;
+			if (home && FrontHit(foodButton, x, y, frontZ)) { // time to feed the fishies
+				if (!tank.feeding) {
+					tank.feeding = true;
 					foodButton.SetFrame(1);
 				}
 				else {
-					feedingTime = false;
+					tank.feeding = false;
 					foodButton.SetFrame(0);
-					pelletsVec.clear(); // if done feeding, clear pellets from screen
+					tank.ClearPellets(); // if done feeding, clear pellets from screen
 				}
 			}
-			if (shopButton.Hit(x, y) || xButton.Hit(x, y)) { // whether pulling up shop or exiting, change background
+			if ((home && FrontHit(shopButton, x, y, frontZ)) || (shop && FrontHit(xButton, x, y, frontZ))) { // whether pulling up shop or exiting, change background
 				displayShop = !displayShop;
 				displayShop ? background.SetFrame(2) : background.SetFrame(1);
 			}
 
-			if (background.Hit(x, y) && feedingTime) { // clicking on open space to spawn pellet
+			if (home && FrontHit(background, x, y, frontZ) && tank.feeding) { // clicking on open space to spawn pellet
 				spawnPellet(x, y);
 			}
 
 
 			for (int i = 0; i < buyButtonsVec.size(); i++) { // check in vector to see if a buy button has been clicked
-				if (buyButtonsVec[i].Hit(x, y)) {
+				if (shop && FrontHit(buyButtonsVec[i], x, y, frontZ)) {
 					bool transactionApproved = false; // for console message after
 					
 					ItemType item = (ItemType)i; // index matching with enum
 					switch (item) { // for each case, if player has enough money, pay up for item
 						case BOAT:
-							if (money >= 30 && buyBoat == false) {
-								money -= 30;
+							if (tank.money >= 30 && buyBoat == false) {
+								tank.money -= 30;
 								buyBoat = true;
 								transactionApproved = true;
 							}
 							break;
 						case CHEST:
-							if (money >= 40 && buyChest == false) {
-								money -= 40;
+							if (tank.money >= 40 && buyChest == false) {
+								tank.money -= 40;
 								transactionApproved = true;
 								buyChest = true;
 							}
 							break;
 						case VOLCANO:
-							if (money >= 50 && buyVolcano == false) {
-								money -= 50;
+							if (tank.money >= 50 && buyVolcano == false) {
+								tank.money -= 50;
 								transactionApproved = true;
 								buyVolcano = true;
 							}
 							break;
 
 						case SNAIL:
-							if (numFish < capacity && money >= 20 && buySnail == false) { // for fishes, need to buy capacity upgrade to be able to buy fish as well
-								money -= 20;
+							if (tank.numFish < capacity && tank.money >= 20 && buySnail == false) { // for fishes, need to buy capacity upgrade to be able to buy fish as well
+								tank.money -= 20;
 								transactionApproved = true;
-								numFish++;
+								tank.numFish++;
 								buySnail = true;
+								tank.entities.SetSprite(tank.AddCreature(KIND_SNAIL), &snail);
 							}
 							break;
 						case UPGRADE:
-							if (numUpgrades < 3 && money >= 10 && buyUpgrade == false) { // only 3 upgrades available, same button can be clicked 3 times
+							if (numUpgrades < 3 && tank.money >= 10 && buyUpgrade == false) { // only 3 upgrades available, same button can be clicked 3 times
 								transactionApproved = true;
-								money -= 10;
+								tank.money -= 10;
 								numUpgrades++;
 								capacity++;
 								buyButtonsVec[i].SetFrame(0);
@@ -650,19 +607,21 @@ void MouseButton(float x, float y, bool left, bool down) {
 							
 							break;
 						case REDFISH:
-							if (numFish < capacity && money >= 15 && buyRedfish == false) {
+							if (tank.numFish < capacity && tank.money >= 15 && buyRedfish == false) {
 								transactionApproved = true;
-								money -= 15;
-								numFish++;
+								tank.money -= 15;
+								tank.numFish++;
 								buyRedfish = true;
+								tank.entities.SetSprite(tank.AddCreature(KIND_REDFISH), &redfish);
 							}
 							break;
 						case GOLDFISH:
-							if (numFish < capacity && money >= 5 && buyGoldfish == false) {
+							if (tank.numFish < capacity && tank.money >= 5 && buyGoldfish == false) {
 								transactionApproved = true;
-								money -= 5;
-								numFish++;
+								tank.money -= 5;
+								tank.numFish++;
 								buyGoldfish = true;
+								tank.entities.SetSprite(tank.AddCreature(KIND_GOLDFISH), &goldfish);
 							}
 							break;
 						default:
@@ -680,13 +639,12 @@ void MouseButton(float x, float y, bool left, bool down) {
 				}
 			}
 
-			for (vector<Sprite>::iterator it = messVec.begin(); it != messVec.end();) { // check if player is cleaning up mess
-				if (it->Hit(x, y)) {
-					it = messVec.erase(it);
-					money += 0.5; // they get money for it!
-				}
-				else {
-					++it;
+			vector<Sprite *> nearClick;
+			messHash.QueryPoint(NDCfromScreen(x, y), nearClick);
+			for (Sprite *mess : nearClick) { // check if player is cleaning up mess
+				if (home && FrontHit(*mess, x, y, frontZ)) {
+					tank.CleanMess(tank.entities.Find(mess)); // they get money for it! (releasing the sprite drops its reference to the algae texture)
+					break; // only the front-most mess is under the cursor
 				}
 			}
 		}
@@ -696,7 +654,21 @@ void MouseButton(float x, float y, bool left, bool down) {
 void Keyboard(int key, bool press, bool shift, bool control) {
 	if (press) {
 		if (key == 'F') { // dev cheats to speed up demo/tests
-			money += 50;
+			tank.money += 50;
+		}
+		if (key == 'S') // toggle schooling
+			tank.schooling = !tank.schooling;
+		if (key == 'P') // screenshot after the next frame is drawn
+			screenshot = true;
+		if (key == 'C') { // toggle capture of every frame
+			capturing = !capturing;
+			printf("capture %s\n", capturing ? "on" : "off");
+		}
+		if (key == 'V') { // toggle video recording, for regression comparison
+			if (Recording())
+				StopRecording();
+			else
+				StartRecording((captureDir + "Tank.y4m").c_str());
 		}
 	}
 }
@@ -705,65 +677,93 @@ void Keyboard(int key, bool press, bool shift, bool control) {
 
 
 void Resize(int w, int h) {
-	glViewport(0, 0, w, h);
+	SetViewport(0, 0, w, h);
 	for (Sprite* s : actors)
 		s->UpdateTransform();
 }
 
 const char* usage = R"(Usage:
-	left click mouse only, and f key for cheats
+	left click mouse only, f key for cheats, s key to toggle schooling
+	p key for a screenshot, c key to toggle capture of every frame (numbered tga files)
+	v key to start or stop recording video (Tank.y4m)
+	-headless <seconds> [fish] [-school]: simulate without a window, print the economy
+	-captures <folder>: where screenshots, frames and video are saved (else the working directory)
 )";
 
+int runHeadless(double seconds, int nFish, bool school) {
+	// no GLFW, no sprites: a scripted player keeps a pellet per ten fish in the tank and cleans each mess as it appears
+	TankSimulation t;
+	t.schooling = school;
+	for (int k = 1; k < nFish; k++) { // extra fish scattered about the tank
+		int i = t.entities.Index(t.AddCreature(KIND_FISH));
+		t.entities.x[i] = t.entities.px[i] = t.Random(-1.4f, 1.4f);
+		t.entities.y[i] = t.entities.py[i] = t.Random(-.75f, .75f);
+	}
+	t.numFish = nFish;
+	t.feeding = true;
+	for (long long n = (long long) (seconds / t.dt); n > 0; n--) {
+		for (int k = t.entities.Count(KIND_PELLET); k < max(1, nFish / 10); k++)
+			t.DropPellet(vec2(t.Random(-1.f, 1.f), t.Random(-.8f, .8f)));
+		for (int m; (m = t.entities.First(KIND_MESS)) != 0; )
+			t.CleanMess(m);
+		t.Step();
+	}
+	printf("%.0f seconds, %d fish: money %.2f, %d pellets eaten, %d messes cleaned\n", t.time, nFish, t.money, t.nEaten, t.nMessesCleaned);
+	return 0;
+}
+
 
 
 int main(int ac, char** av) {
-	clock_t startTime = clock(); // keep track of time to generate money
-	clock_t messTime = clock(); // keep track of time to generate algae sprites
+	if (ac > 2 && !strcmp(av[1], "-headless"))
+		return runHeadless(atof(av[2]), ac > 3 ? max(1, atoi(av[3])) : 1, ac > 4 && !strcmp(av[4], "-school"));
+	if (ac > 2 && !strcmp(av[1], "-captures")) {
+		captureDir = av[2];
+		if (captureDir.back() != '/' && captureDir.back() != '\\')
+			captureDir += '/';
+	}
 
 	GLFWwindow* w = InitGLFW(100, 100, 1000, 600, "Eddie's Fish Tank");
 
 	// read background, foreground sprites for title screen
 	setup();
+	SetTextSDF(true); // HUD text is large: distance-field glyphs stay sharp
 
 	// callbacks
 	RegisterMouseButton(MouseButton);
 	RegisterResize(Resize);
 	RegisterKeyboard(Keyboard);
+	tank.itemAdded = spawnMess;
+	tank.itemRemoved = removeSprite;
+	tank.eats = fishEats;
 	
 	wav.OpenDevice(); // connect to audio device
 
 	// event loop
 	printf(usage);
+	std::chrono::steady_clock::time_point lastTime = std::chrono::steady_clock::now(); // wall time, unlike clock()
 	while (!glfwWindowShouldClose(w)) {
+		std::chrono::steady_clock::time_point currentTime = std::chrono::steady_clock::now();
+		double elapsed = std::chrono::duration<double>(currentTime - lastTime).count();
+		lastTime = currentTime;
 
-		if (startGame) {
-			clock_t currentTime = clock();
-
-			if ((float)(currentTime - startTime) / CLOCKS_PER_SEC >= 1.0) { // every second, generate money based on number of fish in tank
-				money += numFish * 0.05;
-				startTime = clock();
-			}
-
-			if ((float)(currentTime - messTime) / CLOCKS_PER_SEC >= 15.0) { // every 15 seconds, generate a mess somewhere on screen
-				spawnMess();
-				messTime = clock();
-			}
-
-			if (buySnail) {
-				snailMove();
-			}
-			if (buyRedfish)
-				redfishMove();
-
-			if (buyGoldfish)
-				goldfishMove();
-
-			fishMove();
-		}
-
+		if (startGame) // fixed steps for money, messes and swimming, then show sprites between steps
+			showTank(tank.Advance(elapsed));
 
+		UpdateAssets(); // upload images decoded since last frame, within a small time budget
 		Display();
+		if (screenshot)
+			CaptureFrame((captureDir + "Screenshot.png").c_str());
+		if (capturing) { // tga: cheap to encode, so the workers keep up at 60 fps
+			char name[100];
+			snprintf(name, sizeof(name), "Capture%05d.tga", nCaptured++);
+			CaptureFrame((captureDir + name).c_str());
+		}
+		RecordFrame(); // if recording
+		screenshot = false;
 		glfwSwapBuffers(w);
 		glfwPollEvents();
 	}
-}
\ No newline at end of file
+	StopRecording();
+	FinishCaptures(); // write out frames still in flight
+}
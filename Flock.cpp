@@ -0,0 +1,108 @@
+// Flock.cpp - schooling (boids) for fish entities
+
+#include <algorithm>
+#include <math.h>
+#include "Flock.h"
+
+void Flock::Sort(Entities &e, vec2 maxP) {
+	// counting sort of fish into cells, positions and velocities copied in cell order
+	fish.resize(0);
+	for (int i = 0; i < e.Size(); i++)
+		if (e.kind[i] == KIND_FISH)
+			fish.push_back(i);
+	int n = (int) fish.size();
+	x0 = -maxP.x-margin;
+	y0 = -maxP.y-margin;
+	cols = std::max(1, (int) ceil(2*(maxP.x+margin)/radius));
+	rows = std::max(1, (int) ceil(2*(maxP.y+margin)/radius));
+	cellStart.assign(cols*rows+1, 0);
+	cellOf.resize(n);
+	for (int k = 0; k < n; k++) {
+		int i = fish[k];
+		int cx = std::min(cols-1, std::max(0, (int) ((e.x[i]-x0)/radius)));
+		int cy = std::min(rows-1, std::max(0, (int) ((e.y[i]-y0)/radius)));
+		cellOf[k] = cy*cols+cx;
+		cellStart[cellOf[k]+1]++;
+	}
+	for (int c = 0; c < cols*rows; c++)
+		cellStart[c+1] += cellStart[c];
+	px.resize(n); py.resize(n); pvx.resize(n); pvy.resize(n);
+	nvx.resize(n); nvy.resize(n);
+	vector<int> sorted(n), fill(cellStart.begin(), cellStart.end()-1);
+	for (int k = 0; k < n; k++) {
+		int s = fill[cellOf[k]]++, i = fish[k];
+		sorted[s] = i;
+		px[s] = e.x[i]; py[s] = e.y[i];
+		pvx[s] = e.vx[i]; pvy[s] = e.vy[i];
+	}
+	fish.swap(sorted);
+}
+
+void Flock::SteerRange(int begin, int end, float dt, vec2 maxP, vec2 *target) {
+	float r2 = radius*radius, ps2 = personalSpace*personalSpace;
+	for (int s = begin; s < end; s++) {
+		float x = px[s], y = py[s], vx = pvx[s], vy = pvy[s];
+		int cx = std::min(cols-1, std::max(0, (int) ((x-x0)/radius)));
+		int cy = std::min(rows-1, std::max(0, (int) ((y-y0)/radius)));
+		float sepX = 0, sepY = 0, sumX = 0, sumY = 0, sumVx = 0, sumVy = 0;
+		int count = 0;
+		for (int j = std::max(0, cy-1); j <= std::min(rows-1, cy+1) && count < maxNeighbors; j++)
+			for (int c = j*cols+std::max(0, cx-1), cEnd = j*cols+std::min(cols-1, cx+1); c <= cEnd && count < maxNeighbors; c++)
+				for (int t = cellStart[c]; t < cellStart[c+1] && count < maxNeighbors; t++) {
+					float dx = x-px[t], dy = y-py[t], d2 = dx*dx+dy*dy;
+					if (t == s || d2 > r2)
+						continue;
+					count++;
+					sumX += px[t]; sumY += py[t];
+					sumVx += pvx[t]; sumVy += pvy[t];
+					if (d2 < ps2 && d2 > 0) {
+						// push apart, harder when closer
+						float d = sqrt(d2), w = (personalSpace-d)/(personalSpace*d);
+						sepX += w*dx;
+						sepY += w*dy;
+					}
+				}
+		float ax = separation*sepX, ay = separation*sepY;
+		if (count) {
+			ax += alignment*(sumVx/count-vx)+cohesion*(sumX/count-x);
+			ay += alignment*(sumVy/count-vy)+cohesion*(sumY/count-y);
+		}
+		if (target) {
+			// as the lone fish's pursuit: unit vector toward food, times swim speed
+			float dx = target->x-x, dy = target->y-y, len = sqrt(dx*dx+dy*dy);
+			if (len > 0) {
+				ax += food*(maxSpeed*dx/len-vx);
+				ay += food*(maxSpeed*dy/len-vy);
+			}
+		}
+		// turn from walls, harder when nearer
+		float wallX = maxP.x-margin, wallY = maxP.y-margin;
+		if (fabs(x) > wallX)
+			ax -= wall*(x > 0? x-wallX : x+wallX)/margin;
+		if (fabs(y) > wallY)
+			ay -= wall*(y > 0? y-wallY : y+wallY)/margin;
+		vx += dt*ax;
+		vy += dt*ay;
+		float speed = sqrt(vx*vx+vy*vy);
+		float clamp = speed > maxSpeed? maxSpeed/speed : speed < minSpeed && speed > 0? minSpeed/speed : 1;
+		nvx[s] = clamp*vx;
+		nvy[s] = clamp*vy;
+	}
+}
+
+void Flock::Steer(Entities &e, float dt, vec2 maxP, vec2 *target, ThreadPool *pool) {
+	Sort(e, maxP);
+	int n = (int) fish.size();
+	// neighbors read old velocities, so ranges may run concurrently
+	std::function<void(int, int)> range = [&](int begin, int end) { SteerRange(begin, end, dt, maxP, target); };
+	if (pool)
+		pool->ParallelFor(n, range, 512);
+	else
+		range(0, n);
+	for (int s = 0; s < n; s++) {
+		int i = fish[s];
+		e.vx[i] = nvx[s];
+		e.vy[i] = nvy[s];
+		e.motion[i] = FLOCK;
+	}
+}
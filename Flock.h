@@ -0,0 +1,39 @@
+// Flock.h - schooling (boids) for fish entities
+
+#ifndef FLOCK_HDR
+#define FLOCK_HDR
+
+#include <vector>
+#include "Entities.h"
+#include "ThreadPool.h"
+#include "VecMat.h"
+
+using std::vector;
+
+// each step, fish are counting-sorted into a uniform grid of cells radius wide,
+// so a fish sees its neighbors by scanning 3x3 cells: O(n) for bounded density;
+// steering (separation, alignment, cohesion, food, walls) is an acceleration,
+// computed in parallel into new velocities, then applied
+
+class Flock {
+public:
+	float radius = .15f;				// neighbors within, NDC
+	float personalSpace = .06f;			// separate from neighbors within
+	int maxNeighbors = 12;				// as real schools, heed only a few (bounds cost in crowds)
+	float separation = 3, alignment = 2, cohesion = 1.5f, food = 3, wall = 4;	// steering weights
+	float margin = .2f;					// turn from walls within
+	float minSpeed = .1f, maxSpeed = .3f;	// NDC per second
+	void Steer(Entities &e, float dt, vec2 maxP, vec2 *target = NULL, ThreadPool *pool = NULL);
+		// set velocity of all KIND_FISH entities (and motion to FLOCK); the tank spans
+		// -maxP to maxP; if target (eg, a pellet), fish are drawn to it
+private:
+	vector<int> fish, cellStart, cellOf;	// entity indices; per-cell start in sorted arrays
+	vector<float> px, py, pvx, pvy;			// positions, velocities in cell order
+	vector<float> nvx, nvy;					// new velocities, cell order
+	int cols = 0, rows = 0;
+	float x0 = 0, y0 = 0;
+	void Sort(Entities &e, vec2 maxP);
+	void SteerRange(int begin, int end, float dt, vec2 maxP, vec2 *target);
+};
+
+#endif
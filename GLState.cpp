@@ -0,0 +1,175 @@
+// GLState.cpp - CPU-side shadow of GL state, for query without glGet and redundant-set elimination
+
+#include "GLState.h"
+
+namespace {
+
+const int nUnits = 32, unknown = -1;
+
+// capabilities shadowed; others pass through
+const GLenum caps[] = { GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_LINE_SMOOTH, GL_SCISSOR_TEST,
+						GL_PROGRAM_POINT_SIZE, 0x8861 }; // 0x8861 same as GL_POINT_SMOOTH, GL_POINT_SPRITE
+const int nCaps = sizeof(caps)/sizeof(GLenum);
+
+struct State {
+	bool viewportKnown = false, depthRangeKnown = false;
+	int4 viewport;
+	vec2 depthRange;
+	GLint program = unknown, vao = unknown, activeUnit = unknown;
+	GLint tex2D[nUnits], texArray[nUnits];		// per unit
+	int capOn[nCaps];							// 1, 0, or unknown
+	GLint blendSrc = unknown, blendDst = unknown;
+	State() {
+		for (int i = 0; i < nUnits; i++)
+			tex2D[i] = texArray[i] = unknown;
+		for (int i = 0; i < nCaps; i++)
+			capOn[i] = unknown;
+	}
+} s;
+
+int CapIndex(GLenum cap) {
+	for (int i = 0; i < nCaps; i++)
+		if (caps[i] == cap)
+			return i;
+	return -1;
+}
+
+int ActiveUnit() {
+	if (s.activeUnit == unknown) {
+		glGetIntegerv(GL_ACTIVE_TEXTURE, &s.activeUnit);
+		s.activeUnit -= GL_TEXTURE0;
+	}
+	return s.activeUnit;
+}
+
+GLint *Binding(GLenum target, int unit) {
+	if (unit < 0 || unit >= nUnits)
+		return NULL;
+	return target == GL_TEXTURE_2D? &s.tex2D[unit] : target == GL_TEXTURE_2D_ARRAY? &s.texArray[unit] : NULL;
+}
+
+} // end namespace
+
+// viewport
+
+void SetViewport(int x, int y, int width, int height) {
+	int4 vp(x, y, width, height);
+	if (s.viewportKnown && s.viewport == vp)
+		return;
+	glViewport(x, y, width, height);
+	s.viewport = vp;
+	s.viewportKnown = true;
+}
+
+void SetViewport(int4 vp) { SetViewport(vp[0], vp[1], vp[2], vp[3]); }
+
+int4 GetViewport() {
+	if (!s.viewportKnown) {
+		glGetIntegerv(GL_VIEWPORT, (int *) &s.viewport);
+		s.viewportKnown = true;
+	}
+	return s.viewport;
+}
+
+vec2 GetDepthRange() {
+	// no setter here: glDepthRange is rare, and should be followed by InvalidateGLState
+	if (!s.depthRangeKnown) {
+		glGetFloatv(GL_DEPTH_RANGE, (float *) &s.depthRange);
+		s.depthRangeKnown = true;
+	}
+	return s.depthRange;
+}
+
+// program, vertex array
+
+void UseProgram(GLuint program) {
+	if (s.program != (GLint) program) {
+		glUseProgram(program);
+		s.program = program;
+	}
+}
+
+GLuint GetProgram() {
+	if (s.program == unknown)
+		glGetIntegerv(GL_CURRENT_PROGRAM, &s.program);
+	return s.program;
+}
+
+void BindVertexArray(GLuint vao) {
+	if (s.vao != (GLint) vao) {
+		glBindVertexArray(vao);
+		s.vao = vao;
+	}
+}
+
+void DeleteVertexArrays(GLsizei n, const GLuint *vaos) {
+	for (int i = 0; i < n; i++)
+		if (s.vao == (GLint) vaos[i])
+			s.vao = 0;
+	glDeleteVertexArrays(n, vaos);
+}
+
+// textures
+
+void ActiveTexture(GLenum texture) {
+	int unit = texture-GL_TEXTURE0;
+	if (s.activeUnit != unit) {
+		glActiveTexture(texture);
+		s.activeUnit = unit;
+	}
+}
+
+void BindTexture(GLenum target, GLuint texture) {
+	GLint *b = Binding(target, ActiveUnit());
+	if (b && *b == (GLint) texture)
+		return;
+	glBindTexture(target, texture);
+	if (b)
+		*b = texture;
+}
+
+void DeleteTextures(GLsizei n, const GLuint *textures) {
+	for (int i = 0; i < n; i++)
+		for (int u = 0; u < nUnits; u++) {
+			if (s.tex2D[u] == (GLint) textures[i]) s.tex2D[u] = 0;
+			if (s.texArray[u] == (GLint) textures[i]) s.texArray[u] = 0;
+		}
+	glDeleteTextures(n, textures);
+}
+
+// capabilities
+
+void Enable(GLenum cap) {
+	int i = CapIndex(cap);
+	if (i < 0 || s.capOn[i] != 1)
+		glEnable(cap);
+	if (i >= 0)
+		s.capOn[i] = 1;
+}
+
+void Disable(GLenum cap) {
+	int i = CapIndex(cap);
+	if (i < 0 || s.capOn[i] != 0)
+		glDisable(cap);
+	if (i >= 0)
+		s.capOn[i] = 0;
+}
+
+bool IsEnabled(GLenum cap) {
+	int i = CapIndex(cap);
+	if (i < 0)
+		return glIsEnabled(cap) == GL_TRUE;
+	if (s.capOn[i] == unknown)
+		s.capOn[i] = glIsEnabled(cap) == GL_TRUE? 1 : 0;
+	return s.capOn[i] == 1;
+}
+
+void BlendFunc(GLenum sfactor, GLenum dfactor) {
+	if (s.blendSrc != (GLint) sfactor || s.blendDst != (GLint) dfactor) {
+		glBlendFunc(sfactor, dfactor);
+		s.blendSrc = sfactor;
+		s.blendDst = dfactor;
+	}
+}
+
+void InvalidateGLState() { s = State(); }
@@ -0,0 +1,48 @@
+// GLState.h - CPU-side shadow of GL state, for query without glGet and redundant-set elimination
+
+#ifndef GL_STATE_HDR
+#define GL_STATE_HDR
+
+#include <glad.h>
+#include "VecMat.h"
+
+// each function below is a drop-in for its gl namesake: the call reaches GL only
+// if the shadowed value differs; a shadowed value starts unknown, and is read
+// from GL (once) on first query; code that changes this state with direct gl
+// calls (eg, a third-party library) should then call InvalidateGLState
+
+// viewport
+
+void SetViewport(int x, int y, int width, int height);
+void SetViewport(int4 vp);
+int4 GetViewport();
+vec2 GetDepthRange();
+
+// program, vertex array
+
+void UseProgram(GLuint program);
+GLuint GetProgram();
+void BindVertexArray(GLuint vao);
+void DeleteVertexArrays(GLsizei n, const GLuint *vaos);
+	// also forgets a deleted vao if bound (GL reverts to 0)
+
+// textures
+
+void ActiveTexture(GLenum texture);
+	// texture is GL_TEXTURE0+unit, as for glActiveTexture
+void BindTexture(GLenum target, GLuint texture);
+	// GL_TEXTURE_2D and GL_TEXTURE_2D_ARRAY are shadowed for units 0-31
+void DeleteTextures(GLsizei n, const GLuint *textures);
+	// also forgets deleted textures in shadowed bindings (GL reverts to 0)
+
+// capabilities
+
+void Enable(GLenum cap);
+void Disable(GLenum cap);
+bool IsEnabled(GLenum cap);
+void BlendFunc(GLenum sfactor, GLenum dfactor);
+
+void InvalidateGLState();
+	// forget all shadowed values
+
+#endif
@@ -2,6 +2,7 @@
 // Copyright (c) 2024 Jules Bloomenthal, all rights reserved. Commercial use requires license.
 
 #include <glad/glad.h>
+#include "GLState.h"
 #include "GLXtras.h"
 #include <stdio.h>
 #include <string.h>
@@ -380,6 +381,88 @@ GLuint CompileShaderViaCode(const char **code, GLint type) {
 	return shader;
 }
 
+// Uniform Location Cache
+
+namespace {
+
+struct UniformEntry {
+	const std::string *name;	// key in UniformCache::byName
+	GLint location;
+};
+
+struct UniformCache {
+	std::unordered_map<std::string, GLint> byName;
+	std::unordered_map<const char *, UniformEntry> byPointer;
+		// callers nearly always pass string literals, so look up by address first
+		// (verified with strcmp) and avoid hashing the name
+};
+
+const size_t maxPointers = 256;
+	// names built at run-time (stack buffers, temporary strings) arrive at ever new
+	// addresses; past this many, byPointer is emptied and refills with those in use
+
+std::unordered_map<GLuint, UniformCache> uniformCaches;
+GLuint lastCacheProgram = 0;
+UniformCache *lastCache = NULL;
+
+UniformCache &GetUniformCache(GLuint program) {
+	if (!lastCache || program != lastCacheProgram) {
+		lastCache = &uniformCaches[program]; // references to map elements survive rehash
+		lastCacheProgram = program;
+	}
+	return *lastCache;
+}
+
+} // end namespace
+
+void CacheUniforms(GLuint program) {
+	// record the location of each active uniform; called once per link
+	UniformCache &c = GetUniformCache(program);
+	c.byName.clear();
+	c.byPointer.clear();
+	GLint nUniforms = 0, maxLength = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &nUniforms);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	std::vector<char> name(maxLength+1);
+	for (int i = 0; i < nUniforms; i++) {
+		GLint size;
+		GLenum type;
+		glGetActiveUniform(program, i, maxLength+1, NULL, &size, &type, name.data());
+		GLint location = glGetUniformLocation(program, name.data());
+		if (location < 0)
+			continue;								// eg, uniform block member
+		c.byName[std::string(name.data())] = location;
+		char *bracket = strstr(name.data(), "[0]");
+		if (bracket) {
+			*bracket = 0;							// array may be named without [0]
+			c.byName[std::string(name.data())] = location;
+		}
+	}
+}
+
+void ReleaseUniforms(GLuint program) {
+	uniformCaches.erase(program);
+	if (program == lastCacheProgram) {
+		lastCache = NULL;
+		lastCacheProgram = 0;
+	}
+}
+
+GLint UniformLocation(GLuint program, const char *name) {
+	UniformCache &c = GetUniformCache(program);
+	auto p = c.byPointer.find(name);
+	if (p != c.byPointer.end() && !strcmp(name, p->second.name->c_str()))
+		return p->second.location;
+	auto n = c.byName.find(std::string(name));
+	if (n == c.byName.end())
+		// not active at link (eg, array element), or program linked elsewhere
+		n = c.byName.emplace(std::string(name), glGetUniformLocation(program, name)).first;
+	if (c.byPointer.size() >= maxPointers)
+		c.byPointer.clear();
+	c.byPointer[name] = { &n->first, n->second };
+	return n->second;
+}
+
 // Linking
 
 GLuint LinkProgramViaCode(const char **vertexCode, const char **pixelCode) {
@@ -424,6 +507,7 @@ void LinkProgramViaCode(GLuint computeProgram, const char **computeCode) {
 	GLint status;
 	glGetProgramiv(computeProgram, GL_LINK_STATUS, &status);
 	if (status == GL_FALSE) PrintProgramLog(computeProgram);
+	else CacheUniforms(computeProgram);
 }
 
 GLuint LinkProgramViaCode(const char **computeCode) {
@@ -442,6 +526,7 @@ GLuint LinkProgramViaFile(const char *computeShaderFile) {
 	GLint status;
 	glGetProgramiv(program, GL_LINK_STATUS, &status);
 	if (status == GL_FALSE) PrintProgramLog(program);
+	else CacheUniforms(program);
 	return program;
 }
 
@@ -472,6 +557,7 @@ bool ReadProgramBinary(GLuint program, const char *filename) {
 		fread((char *) &data[0], 1, sizeBinary, in);
 		fclose(in);
 		glProgramBinary(program, binaryFormat, &data[0], sizeBinary);
+		CacheUniforms(program);
 		return true;
 	}
 	return false;
@@ -509,6 +595,7 @@ GLuint LinkProgram(GLuint vshader, GLuint tcshader, GLuint teshader, GLuint gsha
 		GLint status;
 		glGetProgramiv(program, GL_LINK_STATUS, &status);
 		if (status == GL_FALSE) PrintProgramLog(program);
+		else CacheUniforms(program);
 	}
 	return program;
 }
@@ -521,11 +608,7 @@ GLuint LinkProgramViaFile(const char *vertexShaderFile, const char *pixelShaderF
 
 // Miscellany
 
-int CurrentProgram() {
-	int program = 0;
-	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
-	return program;
-}
+int CurrentProgram() { return GetProgram(); }
 
 void DeleteProgram(GLuint program) {
 	GLint nShaders = 0;
@@ -535,6 +618,7 @@ void DeleteProgram(GLuint program) {
 	for (int i = 0; i < nShaders; i++)
 		glDeleteShader(shaderNames[i]);
 	glDeleteProgram(program);
+	ReleaseUniforms(program);
 }
 
 // Uniform Access
@@ -552,7 +636,7 @@ bool Bad(const char *name) {
 }
 
 bool SetUniform(GLuint program, const char *name, bool val) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform1ui(id, val? 1 : 0);
@@ -560,7 +644,7 @@ bool SetUniform(GLuint program, const char *name, bool val) {
 }
 
 bool SetUniform(GLuint program, const char *name, int val) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform1i(id, val);
@@ -569,7 +653,7 @@ bool SetUniform(GLuint program, const char *name, int val) {
 
 // following might confuse some compilers
 bool SetUniform(GLuint program, const char *name, GLuint val) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform1ui(id, val);
@@ -577,7 +661,7 @@ bool SetUniform(GLuint program, const char *name, GLuint val) {
 }
 
 bool SetUniformv(GLuint program, const char *name, int count, int *v) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform1iv(id, count, v);
@@ -585,7 +669,7 @@ bool SetUniformv(GLuint program, const char *name, int count, int *v) {
 }
 
 bool SetUniform(GLuint program, const char *name, float val) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform1f(id, val);
@@ -593,7 +677,7 @@ bool SetUniform(GLuint program, const char *name, float val) {
 }
 
 bool SetUniformv(GLuint program, const char *name, int count, float *v) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform1fv(id, count, v);
@@ -601,7 +685,7 @@ bool SetUniformv(GLuint program, const char *name, int count, float *v) {
 }
 
 bool SetUniform(GLuint program, const char *name, vec2 v) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform2f(id, v.x, v.y);
@@ -609,7 +693,7 @@ bool SetUniform(GLuint program, const char *name, vec2 v) {
 }
 
 bool SetUniform(GLuint program, const char *name, vec3 v) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform3f(id, v.x, v.y, v.z);
@@ -617,7 +701,7 @@ bool SetUniform(GLuint program, const char *name, vec3 v) {
 }
 
 bool SetUniform(GLuint program, const char *name, vec4 v) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform4f(id, v.x, v.y, v.z, v.w);
@@ -625,7 +709,7 @@ bool SetUniform(GLuint program, const char *name, vec4 v) {
 }
 
 bool SetUniform(GLuint program, const char *name, vec3 *v) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform3fv(id, 1, (float *) v);
@@ -633,7 +717,7 @@ bool SetUniform(GLuint program, const char *name, vec3 *v) {
 }
 
 bool SetUniform(GLuint program, const char *name, vec4 *v) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform4fv(id, 1, (float *) v);
@@ -641,7 +725,7 @@ bool SetUniform(GLuint program, const char *name, vec4 *v) {
 }
 
 bool SetUniform3(GLuint program, const char *name, float *v) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform3fv(id, 1, v);
@@ -649,7 +733,7 @@ bool SetUniform3(GLuint program, const char *name, float *v) {
 }
 
 bool SetUniform2v(GLuint program, const char *name, int count, float *v) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform2fv(id, count, v);
@@ -657,7 +741,7 @@ bool SetUniform2v(GLuint program, const char *name, int count, float *v) {
 }
 
 bool SetUniform3v(GLuint program, const char *name, int count, float *v) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform3fv(id, count, v);
@@ -665,7 +749,7 @@ bool SetUniform3v(GLuint program, const char *name, int count, float *v) {
 }
 
 bool SetUniform4v(GLuint program, const char *name, int count, float *v) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniform4fv(id, count, v);
@@ -681,7 +765,7 @@ bool SetUniform3v(GLuint program, const char *name, int count, float *v, mat4 m)
 }
 
 bool SetUniform(GLuint program, const char *name, mat3 m) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniformMatrix3fv(id, 1, true, (float *) &m[0][0]);
@@ -689,13 +773,69 @@ bool SetUniform(GLuint program, const char *name, mat3 m) {
 }
 
 bool SetUniform(GLuint program, const char *name, mat4 m) {
-	GLint id = glGetUniformLocation(program, name);
+	GLint id = UniformLocation(program, name);
 	if (id < 0)
 		return Bad(name);
 	glUniformMatrix4fv(id, 1, true, (float *) &m[0][0]);
 	return true;
 }
 
+// Uniform Access by Location (from UniformLocation, for the current program)
+
+bool SetUniform(GLint location, bool val) {
+	if (location < 0) return false;
+	glUniform1ui(location, val? 1 : 0);
+	return true;
+}
+
+bool SetUniform(GLint location, int val) {
+	if (location < 0) return false;
+	glUniform1i(location, val);
+	return true;
+}
+
+bool SetUniform(GLint location, GLuint val) {
+	if (location < 0) return false;
+	glUniform1ui(location, val);
+	return true;
+}
+
+bool SetUniform(GLint location, float val) {
+	if (location < 0) return false;
+	glUniform1f(location, val);
+	return true;
+}
+
+bool SetUniform(GLint location, vec2 v) {
+	if (location < 0) return false;
+	glUniform2f(location, v.x, v.y);
+	return true;
+}
+
+bool SetUniform(GLint location, vec3 v) {
+	if (location < 0) return false;
+	glUniform3f(location, v.x, v.y, v.z);
+	return true;
+}
+
+bool SetUniform(GLint location, vec4 v) {
+	if (location < 0) return false;
+	glUniform4f(location, v.x, v.y, v.z, v.w);
+	return true;
+}
+
+bool SetUniform(GLint location, mat3 m) {
+	if (location < 0) return false;
+	glUniformMatrix3fv(location, 1, true, (float *) &m[0][0]);
+	return true;
+}
+
+bool SetUniform(GLint location, mat4 m) {
+	if (location < 0) return false;
+	glUniformMatrix4fv(location, 1, true, (float *) &m[0][0]);
+	return true;
+}
+
 // Attribute Access
 
 void DisableVertexAttribute(GLuint program, const char *name) {
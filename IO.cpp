@@ -2,6 +2,7 @@
 // Copyright (c) 2024 Jules Bloomenthal, all rights reserved. Commercial use requires license.
 
 #include "Draw.h"
+#include "GLState.h"
 #include "IO.h"
 #include <fstream>
 #include <string.h>
@@ -29,7 +30,7 @@ void LoadTexture(unsigned char *pixels, int width, int height, int bpp, unsigned
 				for (int k = 0; k < 3; k++)
 					*t++ = *p++;
 	}
-	glBindTexture(GL_TEXTURE_2D, textureName);      // bind current texture to textureName
+	BindTexture(GL_TEXTURE_2D, textureName);      // bind current texture to textureName
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);          // accommodate width not multiple of 4
 	// specify target, format, dimension, transfer data
 	if (bpp == 4)
@@ -37,7 +38,7 @@ void LoadTexture(unsigned char *pixels, int width, int height, int bpp, unsigned
 	if (bpp == 3)
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, bgr? GL_BGR : GL_RGB, GL_UNSIGNED_BYTE, temp);
 	if (bpp == 1)
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, temp);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, temp);
 	if (mipmap) {
 		glGenerateMipmap(GL_TEXTURE_2D);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -47,7 +48,7 @@ void LoadTexture(unsigned char *pixels, int width, int height, int bpp, unsigned
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	if (false && bpp == 4) delete [] temp;
-	glBindTexture(GL_TEXTURE_2D, 0); // **** ???
+	BindTexture(GL_TEXTURE_2D, 0); // **** ???
 }
 
 GLuint LoadTexture(unsigned char *pixels, int width, int height, int bpp, bool bgr, bool mipmap) {
@@ -69,26 +70,18 @@ bool ReadTexture(const char *filename, GLuint *textureName, bool mipmap, int *n,
 	if (n) *n = nChannels;
 	if (w) *w = width;
 	if (h) *h = height;
-	glGenTextures(1, textureName);
 	*textureName = LoadTexture(data, width, height, nChannels, false, mipmap);
 	stbi_image_free(data);
 	return true;
 }
 
 unsigned char *GetData(int &width, int &height) {
+	// bytes straight from GL (for frames without a stall, see Capture.h)
 	VPsize(width, height);
-	int npixels = width*height;
-	unsigned char *cPixels = new unsigned char[3*npixels], *c = cPixels;
-	float *fPixels = new float[3*npixels*sizeof(float)], *f = fPixels;
-	glReadPixels(0, 0, width, height, GL_RGB, GL_FLOAT, fPixels);
-//	glReadPixels(0, 0, width, height, GL_BGR, GL_FLOAT, fPixels);   // Targa is BGR ordered
-	for (int i = 0; i < npixels; i++) {
-		*c++ = (unsigned char) (255.f*(*f++));
-		*c++ = (unsigned char) (255.f*(*f++));
-		*c++ = (unsigned char) (255.f*(*f++));
-	}
-	delete [] fPixels;
-	return cPixels;
+	unsigned char *pixels = new unsigned char[3*width*height];
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);	// rows of 3*width bytes, unpadded
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+	return pixels;
 }
 
 void SavePng(const char *filename) {
@@ -123,34 +116,45 @@ void SaveJpg(const char *filename, int quality) {
 	delete [] cPixels;
 }
 
-int ReadGIF(const char *filename, vector<GLuint> &textureNames, int *nChannels, vector<float> *frameDurations) {
+unsigned char *DecodeGIF(const char *filename, int &width, int &height, int &nFrames, int &nChannels, vector<float> *frameDurations) {
+	// frames consecutive, each bottom row first; free with stbi_image_free
 	FILE *f = fopen(filename, "rb");
 	if (!f) {
 		printf("can't open %s\n", filename);
-		return false;
+		return NULL;
 	}
 	stbi__context s;
 	stbi__start_file(&s, f);
 	if (!stbi__gif_test(&s)) {
 		printf("%s not GIF format\n", filename);
-		return 0;
+		fclose(f);
+		return NULL;
 	}
-	int width = 0, height = 0, nFrames = 0, nChan = 0;
-	int *delays; // delay[i] is display time for frame[i], in 1/100ths (or 1/1000?) of a second
-	unsigned char *pdata = (unsigned char *) stbi__load_gif_main(&s, &delays, &width, &height, &nFrames, &nChan, 0);
+	width = height = nFrames = nChannels = 0;
+	int *delays = NULL; // delay[i] is display time for frame[i], in 1/100ths (or 1/1000?) of a second
+	unsigned char *pdata = (unsigned char *) stbi__load_gif_main(&s, &delays, &width, &height, &nFrames, &nChannels, 0);
 	fclose(f);
 	if (!pdata) {
 		printf("error reading %s (%s)\n", filename, stbi_failure_reason());
-		return 0;
+		return NULL;
 	}
-	if (nChannels)
-		*nChannels = nChan;
 	if (frameDurations) {
 		frameDurations->resize(nFrames);
 		for (int i = 0; i < nFrames; i++)
 			(*frameDurations)[i] = (float) delays[i]/1000;
 	}
-	stbi__vertical_flip_slices(pdata, width, height, nFrames, nChan);
+	stbi_image_free(delays);
+	stbi__vertical_flip_slices(pdata, width, height, nFrames, nChannels);
+	return pdata;
+}
+
+int ReadGIF(const char *filename, vector<GLuint> &textureNames, int *nChannels, vector<float> *frameDurations) {
+	int width, height, nFrames, nChan;
+	unsigned char *pdata = DecodeGIF(filename, width, height, nFrames, nChan, frameDurations);
+	if (!pdata)
+		return 0;
+	if (nChannels)
+		*nChannels = nChan;
 	textureNames.resize(nFrames);
 	glGenTextures(nFrames, textureNames.data());
 	for (int i = 0; i < nFrames; i++) {
@@ -2,16 +2,24 @@
 // Copyright (c) 2024 Jules Bloomenthal, all rights reserved. Commercial use requires license.
 
 #include <glad.h>
+#include <algorithm>
+#include <vector>
 #include "Draw.h"
+#include "DistanceField.h"
+#include "DrawList.h"
+#include "GLState.h"
 #include "GLXtras.h"
 #include "IO.h"
 #include "Letters.h"
 #include <stdio.h>
+#include <string.h>
+
+using std::vector;
 
 namespace {
 
 // images are 13 lines, each with 284 grayscale values; a value is represented as two hexadecimal characters
-const char *lowerCaseImage = "\
+constexpr char lowerCaseImage[] = "\
 FFFFFFFFFFFFFFFFFFD8000000D8FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF3B00007AFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFB90000000000FFFFFFFFFFFFFFFFFFFFFFFF3B00005CFFFFFFFFFFFFFFFFFFFFFF0000D8FFFFFFFFFFFFFFFFD80000D8FFFFFF9B000000FFFFFFFFFFFFFFFFD8000000009BFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF5C1DFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF\
 FFFFFFFFFFFFFFFFFFD8000000D8FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF3B00007AFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFD8000000000000B9FFFFFFFFFFFFFFFFFFFFFF3B00005CFFFFFFFFFFFFFFFFFFFFFF0000D8FFFFFFFFFFFFFFFFD80000D8FFFFFF9B000000FFFFFFFFFFFFFFFFD8000000009BFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF1D00FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF\
 FFFFFFFFFFFFFFFFFFFFFF3B00D8FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF9B007AFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF9B007AFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFB9005CFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF1D00FFFFFFFFFFFFFFFFFFFFFF7A009BFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF1D00FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF\
@@ -26,7 +34,7 @@ FF1D000000B90000009D000000D800000000D8FFFFFFFFFF1D000000001DFFFFFFFF9B000000009B
 FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF1D00D8FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF1D00B9FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF3B00D8FFFFFFFFFFFFFFFFFFFFFFFFFFFF9B007AFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF9B003BFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF\
 FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF7A00000000003BFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF9B00000000001DFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFD800000000009BFFFFFFFFFFFFFFFFFFFF7A0000000000FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF5C00000000005CFFFFFFFFFFFFFFFFFFFFFFFFFFFF";
 
-const char *upperCaseImage = "\
+constexpr char upperCaseImage[] = "\
 FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF\
 7A000000009BFFFFFFFF3B00000000000000FFFFFFFFFFFF5C0000009B5C1DFF1D000000000000B9FFFFFF3B00000000000000005CFFD80000000000000000009BFFFFFF5C0000009B5C3BFFB90000001DFF00000000B9FF7A00000000000000B9FFFFFFFF9B000000000000005C000000B9FF7A0000003B9B00000000001DFFFFFFD8000000D8FFFFFF9B0000000000009BFFD8000000005CFFFFFF5C0000007AFFFFFFFF1D0000000000005CFFFFFFFFFF5C0000007AFFFFFF3B0000000000001DFFFFFFFFFFFF3B000000B900B9FFB9000000000000000000D81D00003BFFFFFF0000000000000000B9FF9B00000000000000007AFF5C000000003B0000007AFF5C0000005C3B0000009BFF9B0000005CFF9B00000000000000B9\
 7A000000001DFFFFFFFF3B0000000000000000D8FFFFFF0000000000000000FF1D000000000000007AFFFF3B00000000000000005CFFD80000000000000000009BFFFF1D00000000000000FFB90000001DFF00000000B9FF7A00000000000000B9FFFFFFFF9B000000000000005C000000B9FF7A0000003B9B00000000001DFFFFFFD80000005CFFFFFF3B00000000000000FFD8000000005CFFFF0000000000001DFFFFFF1D000000000000003BFFFFFF0000000000001DFFFF3B0000000000000000FFFFFFFF1D0000000000009BFFB9000000000000000000D81D00003BFFFFFF0000000000000000B9FF9B00000000000000007AFF5C000000003B0000007AFF5C0000005C3B0000007AFF9B0000005CFF9B00000000000000B9\
@@ -42,7 +50,7 @@ D80000000000001DFFFFFFB9005CFFFFFFB90000D8B9007AFFFFFFFFFFFFFFFFFF3B00D8FFFFFFFF
 FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF1D000000D8D800B9FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF";
 
 // next 10 lines each with 82 grayscale values, each value represented as two hexadecimal characters
-const char *numberImage = "\
+constexpr char numberImage[] = "\
 FFEC7A110034C3FFFFDD98340047FFFFFFFFA723002389FFFFFF000000117AFFFFFFFFFFC3000089FFFF890000000000FFFFFFFFA734000089FF89000000000000C3FFDD57000023A7FFFFEC69110034B5FF\
 FF470000000011DDFF5700000047FFFFFF980000000000B5FFFF000000000098FFFFFFFF23000089FFFF890000000000FFFFFF690000000089FF89000000000000C3FF340000000000D0FF470000000000DD\
 D00011DDFF690069FF987AB50047FFFFFFEC47DDFF89007AFFFFFFFFFF980047FFFFFF89007A0089FFFF8900C3FFFFFFFFFFC30023B5FFFFFFFFFFFFFFFFEC1123FFFF0034ECFFA700C3DD0023DDFF890089\
@@ -54,27 +62,31 @@ B50034DDEC57007AFFFFFFC30047FFFFFFFF690089FFFFFFFFFFFFFFFFDD2300DD47000000000000
 FF340000000011DDFF47000000000047FF98000000000000FFC3000000000047FFFFFFFFFFC30089FFFF470000000011DDFFDD000000000047FFFFEC1111ECFFFFFFEC110000000000C3FF470000000069FF\
 FFEC69000057D0FFFF47000000000047FF89000000000000FFC30000003489ECFFFFFFFFFFC30089FFFF4700001169DDFFFFFFB534001169ECFFFF890089FFFFFFFFFFC334000034B5FFFF4700003498FFFF";
 
-// transform 2D vertex by view, separate uv from vec4
+// 2D vertex already in NDC, separate uv from vec4
 #ifdef __APPLE__
 const char *vertexShader = R"(
 	#version 410 core
 	in vec4 point;
+	in vec3 color;
 	out vec2 vUv;
-	uniform mat4 view;
+	out vec3 vColor;
 	void main() {
-		gl_Position = view*vec4(point.xy, 0, 1);
+		gl_Position = vec4(point.xy, 0, 1);
 		vUv = point.zw;
+		vColor = color;
 	}
 )";
 #else
 const char *vertexShader = R"(
 	#version 130
 	in vec4 point;
+	in vec3 color;
 	out vec2 vUv;
-	uniform mat4 view;
+	out vec3 vColor;
 	void main() {
-		gl_Position = view*vec4(point.xy, 0, 1);
+		gl_Position = vec4(point.xy, 0, 1);
 		vUv = point.zw;
+		vColor = color;
 	}
 )";
 #endif
@@ -84,186 +96,255 @@ const char *vertexShader = R"(
 const char *pixelShader = R"(
 	#version 410 core
 	in vec2 vUv;
+	in vec3 vColor;
 	out vec4 pColor;
 	uniform sampler2D textureImage;
-	uniform vec3 color;
+	uniform bool sdf = false;
 	void main() {
 		float a = texture(textureImage, vUv).r;
-		pColor = vec4(color, 1-a);
+		if (sdf) {
+			// distance field: edge at .5, antialiased over a pixel
+			float w = fwidth(a);
+			pColor = vec4(vColor, smoothstep(.5-w, .5+w, a));
+		}
+		else
+			pColor = vec4(vColor, 1-a);
 	}
 )";
 #else
 const char *pixelShader = R"(
 	#version 130
 	in vec2 vUv;
+	in vec3 vColor;
 	out vec4 pColor;
 	uniform sampler2D textureImage;
-	uniform vec3 color;
+	uniform bool sdf = false;
 	void main() {
 		float a = texture(textureImage, vUv).r;
-		pColor = vec4(color, 1-a);
+		if (sdf) {
+			// distance field: edge at .5, antialiased over a pixel
+			float w = fwidth(a);
+			pColor = vec4(vColor, smoothstep(.5-w, .5+w, a));
+		}
+		else
+			pColor = vec4(vColor, 1-a);
 	}
 )";
 #endif
 
-GLuint shaderProgram = 0, vBufferId = 0;
-GLuint textureNameLower = 0, textureNameUpper = 0, textureNameNumber = 0;
-int textureUnitLower = 2, textureUnitUpper = 3, textureUnitNumber = 4; // this dies if GLUint?!
+// all glyphs share one GL_R8 atlas: lower case, upper case, then numbers, stacked
+// with a blank row between; the atlas is decoded from the hex images at compile time,
+// so first use only uploads it; glyph quads (in NDC, with per-vertex color) accumulate
+// in one vertex array, drawn with a single call by FlushLetters; in SDF mode the
+// atlas is instead a distance field of the same layout, upsampled, so large text
+// has smooth edges rather than magnified texels
 
-} // end namespace
+struct Sheet { const char *image; int nChars, rows, nGlyphs; };
+
+constexpr Sheet sheets[] = {
+	{ lowerCaseImage, sizeof(lowerCaseImage)-1, 13, 26 },
+	{ upperCaseImage, sizeof(upperCaseImage)-1, 13, 26 },
+	{ numberImage, sizeof(numberImage)-1, 10, 10 } };
+
+constexpr int nSheets = sizeof(sheets)/sizeof(Sheet), gutter = 1;
+
+constexpr int SheetWidth(int i) { return sheets[i].nChars/(2*sheets[i].rows); }
+
+constexpr int SheetRow0(int i) { return i == 0? 0 : SheetRow0(i-1)+sheets[i-1].rows+gutter; }
+
+constexpr int AtlasWidth() {
+	int w = 0;
+	for (int i = 0; i < nSheets; i++)
+		w = SheetWidth(i) > w? SheetWidth(i) : w;
+	return w;
+}
+
+constexpr int atlasWidth = AtlasWidth(), atlasHeight = SheetRow0(nSheets-1)+sheets[nSheets-1].rows;
+
+constexpr int Hex(char c) { return c < 58? c-'0' : 10+c-'A'; }
+
+struct AtlasImage { unsigned char pixels[atlasWidth*atlasHeight]; };
 
-int MakeLetterTexture(unsigned char *image) {
-	// create and load texture raster
-	int nchars = (int) strlen(lowerCaseImage), npixels = nchars/2, height = 13, width = npixels/height;
-	unsigned char *pixels = new unsigned char[3*npixels], *p = pixels, *n = (unsigned char *) image;
-	for (int i = 0; i < npixels; i++) {
-		char c1 = *n++, c2 = *n++;
-		int k1 = c1 < 58? c1-'0' : 10+c1-'A', k2 = c2 < 58? c2-'0' : 10+c2-'A', b = 16*k1+k2;
-		for (int k = 0; k < 3; k++)
-			*p++ = (unsigned char) b;
+constexpr AtlasImage DecodeAtlas() {
+	// grayscale, ink dark; first image line is glyph top, stored at lowest v
+	AtlasImage a = {};
+	for (int k = 0; k < atlasWidth*atlasHeight; k++)
+		a.pixels[k] = 255;
+	for (int i = 0; i < nSheets; i++) {
+		const char *n = sheets[i].image;
+		for (int j = 0; j < sheets[i].rows; j++)
+			for (int k = 0; k < SheetWidth(i); k++, n += 2)
+				a.pixels[(SheetRow0(i)+j)*atlasWidth+k] = (unsigned char) (16*Hex(n[0])+Hex(n[1]));
 	}
-	int textureName = LoadTexture(pixels, width, height, 3);
-	delete [] pixels;
-	return textureName;
+	return a;
 }
 
-int MakeNumberTexture(unsigned char *image) {
-	// create and load texture raster
-	int nchars = (int) strlen(numberImage), npixels = nchars/2, height = 10, width = npixels/height;
-	unsigned char *pixels = new unsigned char[3*npixels], *p = pixels, *n = (unsigned char *) image;
-	for (int i = 0; i < npixels; i++) {
-		char c1 = *n++, c2 = *n++;
-		int k1 = c1 < 58? c1-'0' : 10+c1-'A', k2 = c2 < 58? c2-'0' : 10+c2-'A', b = 16*k1+k2;
-		for (int k = 0; k < 3; k++)
-			*p++ = (unsigned char) b;
+static_assert(sheets[0].nChars == 2*sheets[0].rows*SheetWidth(0) &&
+			  sheets[1].nChars == 2*sheets[1].rows*SheetWidth(1) &&
+			  sheets[2].nChars == 2*sheets[2].rows*SheetWidth(2), "glyph image not rows x width");
+
+constexpr AtlasImage atlasImage = DecodeAtlas();
+
+struct LetterVertex { float x, y, u, v; vec3 color; };
+
+GLuint shaderProgram = 0, vao = 0, vBufferId = 0, atlas = 0, sdfAtlas = 0;
+GLint textureImageId = -1, sdfId = -1;
+bool useSDF = false;
+const int sdfUpsample = 4, sdfSpread = 6;	// spread in field pixels
+int textureUnit = 2;
+vector<LetterVertex> vertices;
+DrawList punctuation;
+int deferCount = 0;
+
+GLuint MakeAtlas(bool sdf) {
+	// not mipmapped: glyphs abut (and sheets are a texel apart), so they would bleed
+	// into one another at coarser levels; linear minification instead
+	GLuint a = 0;
+	if (!sdf)
+		a = LoadTexture((unsigned char *) atlasImage.pixels, atlasWidth, atlasHeight, 1, false, false);
+	else {
+		vector<unsigned char> coverage(atlasImage.pixels, atlasImage.pixels+atlasWidth*atlasHeight), field;
+		for (unsigned char &p : coverage)
+			p = 255-p;
+		DistanceField(coverage.data(), atlasWidth, atlasHeight, sdfSpread, field, sdfUpsample);
+		a = LoadTexture(field.data(), sdfUpsample*atlasWidth, sdfUpsample*atlasHeight, 1, false, false);
 	}
-	int textureName = LoadTexture(pixels, width, height, 3);
-	delete [] pixels;
-	return textureName;
+	BindTexture(GL_TEXTURE_2D, a);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	BindTexture(GL_TEXTURE_2D, 0);
+	return a;
 }
 
-void Letter(int x, int y, char c, vec3 color, float ptSize) {
+void AddPunctuation(int x, int y, char c, vec3 color, float ptSize) {
+	float lineWidth = 4; // ptSize/3; // = 2;
+	DrawList &d = punctuation;
+	int size = (int) ptSize, h = (int)(ptSize*.5f);
+	if (c == 40) {
+		vec2 p1(x+h, y+size+1), p2(x+2, y+(int)(.75f*ptSize)), p3(x+2, y+(int)(.25f*ptSize)), p4(x+h, y-1);
+		d.Line(p1, p2, lineWidth, color); d.Line(p2, p3, lineWidth, color); d.Line(p3, p4, lineWidth, color);
+	}
+	if (c == 41) {
+		vec2 p1(x+h, y+size+1), p2(x+size-2, y+(int)(.75f*ptSize)), p3(x+size-2, y+(int)(.25f*ptSize)), p4(x+h, y-1);
+		d.Line(p1, p2, lineWidth, color); d.Line(p2, p3, lineWidth, color); d.Line(p3, p4, lineWidth, color);
+	}
+	if (c == 61) {
+		d.Line(x+1, y+h+3, x+h+6, y+h+3, lineWidth, color);
+		d.Line(x+1, y+h-3, x+h+6, y+h-3, lineWidth, color);
+	}
+	if (c == 43) {
+		d.Line(x+1, y+h+1, x+h+6, y+h+1, lineWidth, color);
+		d.Line(x+h, y+2, x+h, y+h+6, lineWidth, color);
+	}
+	if (c == 45) d.Line(x+1, y+h, x+h+3, y+h, lineWidth, color);
+	if (c == 46) d.Disk(vec2((float) (x+h), (float) (y+3)), ptSize/3, color);
+	if (c == 47) d.Line(x+1, y, x+size-1, y+size, lineWidth, color);
+	if (c == 94) {
+		d.Line(x+1, y+2, x+h, y+h+4, lineWidth, color);
+		d.Line(x+h, y+h+4, x+size-2, y+2, lineWidth, color);
+	}
+}
+
+void AddLetter(int x, int y, char c, vec3 color, float ptSize, vec4 vp) {
 	if (c < 48 || c == 61 || c == 94) { // 32(space), 40((), 41()), 43(+), 45(-), 46(.), 47(/), 61(=), 94(^)
-		float lineWidth = 4; // ptSize/3; // = 2;
-		UseDrawShader(ScreenMode());
-		int size = (int) ptSize, h = (int)(ptSize*.5f), hh = (int)(ptSize*.75f);
-		if (c == 40) {
-			vec2 p1(x+h, y+size+1), p2(x+2, y+(int)(.75f*ptSize)), p3(x+2, y+(int)(.25f*ptSize)), p4(x+h, y-1);
-			Line(p1, p2, lineWidth, color); Line(p2, p3, lineWidth, color); Line(p3, p4, lineWidth, color);
-		}
-		if (c == 41) {
-			vec2 p1(x+h, y+size+1), p2(x+size-2, y+(int)(.75f*ptSize)), p3(x+size-2, y+(int)(.25f*ptSize)), p4(x+h, y-1);
-			Line(p1, p2, lineWidth, color); Line(p2, p3, lineWidth, color); Line(p3, p4, lineWidth, color);
-		}
-		if (c == 61) {
-			Line(x+1, y+h+3, x+h+6, y+h+3, lineWidth, color);
-			Line(x+1, y+h-3, x+h+6, y+h-3, lineWidth, color);
-		}
-		if (c == 43) {
-			Line(x+1, y+h+1, x+h+6, y+h+1, lineWidth, color);
-			Line(x+h, y+2, x+h, y+h+6, lineWidth, color);
-		}
-		if (c == 45) Line(x+1, y+h, x+h+3, y+h, lineWidth, color);
-		if (c == 46) Disk(vec2(x+h, y+3), ptSize/3, color);
-		if (c == 47) Line(x+1, y, x+size-1, y+size, lineWidth, color);
-		if (c == 94) {
-			Line(x+1, y+2, x+h, y+h+4, lineWidth, color);
-			Line(x+h, y+h+4, x+size-2, y+2, lineWidth, color);
-		}
+		AddPunctuation(x, y, c, color, ptSize);
 		return;
 	}
-	enum { Upper, Lower, Number, Unknown } type =
-		c >= 65 && c <= 90?  Upper  :
-		c >= 97 && c <= 122? Lower  :
-		c >= 48 && c <= 57?  Number :
-							 Unknown;
-	if (type == Unknown)
+	int sheet = c >= 97 && c <= 122? 0 : c >= 65 && c <= 90? 1 : c >= 48 && c <= 57? 2 : -1;
+	if (sheet < 0)
 		return;
-	if (!textureNameLower)
-		textureNameLower = MakeLetterTexture((unsigned char *) lowerCaseImage);//, textureUnitLower);
-	if (!textureNameUpper)
-		textureNameUpper = MakeLetterTexture((unsigned char *) upperCaseImage);//, textureUnitUpper);
-	if (!textureNameNumber)
-		textureNameNumber = MakeNumberTexture((unsigned char *) numberImage);//, textureUnitNumber);
-	if (!textureNameLower || !textureNameUpper || !textureNameNumber)
-		printf("can't make texture maps\n");
-	if (!shaderProgram)
+	GLuint &a = useSDF? sdfAtlas : atlas;
+	if (!a && !(a = MakeAtlas(useSDF)))
+		printf("can't make texture map\n");
+	// quad in NDC wrt current viewport, so a deferred flush is unaffected by later viewport change
+	const Sheet &s = sheets[sheet];
+	int glyph = c-(sheet == 0? 'a' : sheet == 1? 'A' : '0');
+	float w = .8f*ptSize, h = ptSize;
+	float x0 = 2*(x-vp[0])/vp[2]-1, y0 = 2*(y-vp[1])/vp[3]-1, x1 = x0+2*w/vp[2], y1 = y0+2*h/vp[3];
+	float du = (float) SheetWidth(sheet)/(atlasWidth*s.nGlyphs), u0 = glyph*du, u1 = u0+du;
+	float v0 = (float) SheetRow0(sheet)/atlasHeight, v1 = (float) (SheetRow0(sheet)+s.rows)/atlasHeight;
+	LetterVertex q[] = { {x0, y0, u0, v1, color}, {x1, y0, u1, v1, color}, {x1, y1, u1, v0, color}, {x0, y1, u0, v0, color} };
+	int tris[] = { 0, 1, 2, 0, 2, 3 };
+	for (int i : tris)
+		vertices.push_back(q[i]);
+}
+
+void FlushLetters() {
+	punctuation.Flush();
+	if (vertices.empty())
+		return;
+	if (!shaderProgram) {
 		shaderProgram = LinkProgramViaCode(&vertexShader, &pixelShader);
-	glUseProgram(shaderProgram);
-	if (!vBufferId) {
+		textureImageId = UniformLocation(shaderProgram, "textureImage");
+		sdfId = UniformLocation(shaderProgram, "sdf");
+	}
+	UseProgram(shaderProgram);
+	if (!vao) {
+		glGenVertexArrays(1, &vao);
 		glGenBuffers(1, &vBufferId);
+		BindVertexArray(vao);
 		glBindBuffer(GL_ARRAY_BUFFER, vBufferId);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(float)*4*6, NULL, GL_DYNAMIC_DRAW);
-			// need 4 vertices for quad, but 6 if triangles
+		VertexAttribPointer(shaderProgram, "point", 4, sizeof(LetterVertex), 0);
+		VertexAttribPointer(shaderProgram, "color", 3, sizeof(LetterVertex), (void *) (4*sizeof(float)));
 	}
+	BindVertexArray(vao);
 	glBindBuffer(GL_ARRAY_BUFFER, vBufferId);
-	VertexAttribPointer(shaderProgram, "point", 4, 4*sizeof(float), 0);
-		// each vertex is 4 floats, stride is 4 floats
-	int texUnit = type == Upper? textureUnitUpper : type == Lower? textureUnitLower : textureUnitNumber;
-	GLuint texName = type == Upper? textureNameUpper : type == Lower? textureNameLower : textureNameNumber;
-	glActiveTexture(GL_TEXTURE0+texUnit);
-	glBindTexture(GL_TEXTURE_2D, texName);
-	// set screen-mode
-	SetUniform(shaderProgram, "view", ScreenMode());
-	// set text color and texture map, activate texture
-	SetUniform(shaderProgram, "color", color);
-	SetUniform(shaderProgram, "textureImage", texUnit);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(LetterVertex), vertices.data(), GL_STREAM_DRAW);
+	ActiveTexture(GL_TEXTURE0+textureUnit);
+	BindTexture(GL_TEXTURE_2D, useSDF? sdfAtlas : atlas);
+	SetUniform(textureImageId, textureUnit);
+	SetUniform(sdfId, useSDF);
 	// enable blended overwrite of color buffer
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	// display character c, value determines horizontal position along texture
-	float w = .8f*ptSize, h = ptSize, xx = (float) x, yy = (float) y;
-	float t = 0, dt = 0;
-	if (type == Number) {
-		int value = c-'0';
-		dt = 1.f/10.f; t = (float) value*dt;
-		float vertices[][4] = { {xx, yy, t, 1}, {xx+w, yy, t+dt, 1}, {xx+w, yy+h, t+dt, 0}, {xx, yy+h, t, 0} };
-		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
+	Enable(GL_BLEND);
+	BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDrawArrays(GL_TRIANGLES, 0, (GLsizei) vertices.size());
+	BindVertexArray(0);
+	vertices.resize(0);
+}
+
+} // end namespace
+
+void SetLetterSDF(bool sdf) {
+	if (sdf != useSDF) {
+		// pending glyphs were laid out for the current atlas
+		GLuint was = GetProgram();
+		FlushLetters();
+		UseProgram(was);
+		useSDF = sdf;
 	}
-	else {
-		int letterID = type == Upper? c-'A' : type == Lower? c-'a' : c-'0';
-		dt = 1.f/26.f; t = (float)letterID*dt;
-	//	float vertices[][4] = { {xx, yy+h, t, 1}, {xx+w, yy+h, t+dt, 1}, {xx+w, yy, t+dt, 0}, {xx, yy, t, 0} };
-		float vertices[][4] = { {xx, yy, t, 1}, {xx+w, yy, t+dt, 1}, {xx+w, yy+h, t+dt, 0}, {xx, yy+h, t, 0} };
-		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
+}
+
+void BeginLetters() { deferCount++; }
+
+void EndLetters() {
+	if (deferCount > 0 && --deferCount == 0) {
+		GLuint was = GetProgram();
+		FlushLetters();
+		UseProgram(was);
 	}
-	// display as one quad or two triangles, mapped to 1/26 width of texture map
-#ifndef __APPLE__
-	glDrawArrays(GL_QUADS, 0, 4);
-#else
-	float vertices[][4] = {{xx, yy, t, 1}, {xx+w, yy, t+dt, 1},   {xx+w, yy+h, t+dt, 0},
-					       {xx, yy, t, 1}, {xx+w, yy+h, t+dt, 0}, {xx, yy+h, t, 0}};
-	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-#endif
-	glBindVertexArray(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Letter(int x, int y, char c, vec3 color, float ptSize) {
+	char s[] = { c, 0 };
+	Letters(x, y, s, color, ptSize);
 }
 
 vec2 Letters(int x, int y, const char *letters, vec3 color, float ptSize) {
-	int was = 0;
-	mat4 drawView = GetDrawView();
-	glGetIntegerv(GL_CURRENT_PROGRAM, &was);
+	GLuint was = GetProgram();
+	vec4 vp = VP();
 	int nlets = strlen(letters);
+	punctuation.SetView(ScreenMode());
 	for (int i = 0; i < nlets; i++)
-		Letter((int) (x+i*ptSize), y, letters[i], color, ptSize);
-	glUseProgram(was);
-	SetDrawView(drawView);
+		AddLetter((int) (x+i*ptSize), y, letters[i], color, ptSize, vp);
+	if (!deferCount)
+		FlushLetters();
+	UseProgram(was);
 	return vec2(x+nlets*ptSize, (float) y);
 }
 
 vec2 Letters(vec3 p, mat4 m, const char *letters, vec3 color, float ptSize) {
-	int was = 0;
-	mat4 drawView = GetDrawView();
-	glGetIntegerv(GL_CURRENT_PROGRAM, &was);
 	vec2 pp = ScreenPoint(p, m);
-	int nlets = strlen(letters);
-	for (int i = 0; i < nlets; i++)
-	//	Letter((int) (pp.x+i*10.9f), (int) pp.y, letters[i], color, ptSize);
-		Letter((int) (pp.x+i*ptSize), (int) pp.y, letters[i], color, ptSize);
-	glUseProgram(was);
-	SetDrawView(drawView);
-	return vec2(pp.x+nlets*ptSize, pp.y);
+	Letters((int) pp.x, (int) pp.y, letters, color, ptSize);
+	return vec2(pp.x+strlen(letters)*ptSize, pp.y);
 }
 
 /*	// method to convert image to hexadecimal data
@@ -0,0 +1,93 @@
+// PointGrid.cpp - uniform grid of points, for nearest-neighbor and box queries
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include "PointGrid.h"
+
+PointGrid::PointGrid(vec2 min, vec2 max, float cellSize) : min(min), cellSize(cellSize) {
+	cols = std::max(1, (int) ceil((max.x-min.x)/cellSize));
+	rows = std::max(1, (int) ceil((max.y-min.y)/cellSize));
+	cells.resize(cols*rows);
+}
+
+int PointGrid::Col(float x) { return std::min(cols-1, std::max(0, (int) floor((x-min.x)/cellSize))); }
+
+int PointGrid::Row(float y) { return std::min(rows-1, std::max(0, (int) floor((y-min.y)/cellSize))); }
+
+void PointGrid::Insert(int id, vec2 p) {
+	Remove(id);
+	int c = Row(p.y)*cols+Col(p.x);
+	slots[id] = { c, (int) cells[c].size() };
+	cells[c].push_back({ id, p, 0 });
+}
+
+void PointGrid::Remove(int id) {
+	auto s = slots.find(id);
+	if (s == slots.end())
+		return;
+	vector<Point> &cell = cells[s->second.cell];
+	int i = s->second.index;
+	if (i != (int) cell.size()-1) {
+		cell[i] = cell.back();
+		slots[cell[i].id].index = i;
+	}
+	cell.pop_back();
+	slots.erase(s);
+}
+
+void PointGrid::Clear() {
+	for (vector<Point> &c : cells)
+		c.resize(0);
+	slots.clear();
+}
+
+void PointGrid::NewRound() { round++; }
+
+void PointGrid::Claim(int id) {
+	auto s = slots.find(id);
+	if (s != slots.end())
+		cells[s->second.cell][s->second.index].claimed = round;
+}
+
+int PointGrid::Nearest(vec2 p, bool unclaimed, float *dist) {
+	int cx = Col(p.x), cy = Row(p.y), best = 0;
+	float bestD2 = FLT_MAX;
+	int maxRing = std::max(std::max(cx, cols-1-cx), std::max(cy, rows-1-cy));
+	for (int r = 0; r <= maxRing; r++) {
+		// cells at Chebyshev distance r from (cx, cy)
+		for (int y = std::max(0, cy-r); y <= std::min(rows-1, cy+r); y++) {
+			bool edge = y == cy-r || y == cy+r;
+			int step = edge? 1 : 2*r;
+			for (int x = cx-r; x <= cx+r; x += std::max(1, step)) {
+				if (x < 0 || x >= cols)
+					continue;
+				for (Point &q : cells[y*cols+x]) {
+					if (unclaimed && q.claimed == round)
+						continue;
+					float dx = q.p.x-p.x, dy = q.p.y-p.y, d2 = dx*dx+dy*dy;
+					if (d2 < bestD2) {
+						bestD2 = d2;
+						best = q.id;
+					}
+				}
+			}
+		}
+		// points in ring r+1 or beyond are at least r cells away (farther if p is outside the grid)
+		float reach = r*cellSize;
+		if (best && bestD2 <= reach*reach)
+			break;
+	}
+	if (dist)
+		*dist = best? sqrt(bestD2) : FLT_MAX;
+	return best;
+}
+
+void PointGrid::QueryBox(vec2 bmin, vec2 bmax, vector<int> &ids) {
+	ids.resize(0);
+	for (int y = Row(bmin.y); y <= Row(bmax.y); y++)
+		for (int x = Col(bmin.x); x <= Col(bmax.x); x++)
+			for (Point &q : cells[y*cols+x])
+				if (q.p.x >= bmin.x && q.p.x <= bmax.x && q.p.y >= bmin.y && q.p.y <= bmax.y)
+					ids.push_back(q.id);
+}
@@ -0,0 +1,44 @@
+// PointGrid.h - uniform grid of points, for nearest-neighbor and box queries
+
+#ifndef POINT_GRID_HDR
+#define POINT_GRID_HDR
+
+#include <unordered_map>
+#include <vector>
+#include "VecMat.h"
+
+using std::vector;
+
+// points (by caller's id) are bucketed into cells over [min, max] (points outside
+// clamp to border cells); insert and remove are O(1), removal swapping the last
+// point of a bucket into the hole; Nearest searches rings of cells outward and
+// stops once no farther ring can hold a closer point
+
+class PointGrid {
+public:
+	PointGrid(vec2 min = vec2(-1.5f, -1.f), vec2 max = vec2(1.5f, 1.f), float cellSize = .2f);
+	void Insert(int id, vec2 p);
+	void Remove(int id);
+	void Clear();
+	int Size() { return (int) slots.size(); }
+	int Nearest(vec2 p, bool unclaimed = false, float *dist = NULL);
+		// id of point nearest p (optionally, not claimed this round), 0 if none
+	void Claim(int id);
+	void NewRound();
+		// forget all claims, O(1)
+	void QueryBox(vec2 min, vec2 max, vector<int> &ids);
+		// ids of points within box
+private:
+	struct Point { int id; vec2 p; unsigned int claimed; };
+	struct Slot { int cell, index; };
+	vec2 min;
+	float cellSize;
+	int cols, rows;
+	unsigned int round = 1;
+	vector<vector<Point>> cells;
+	std::unordered_map<int, Slot> slots;
+	int Col(float x);
+	int Row(float y);
+};
+
+#endif
@@ -0,0 +1,270 @@
+// Recorder.cpp - record the window as Y4M video, to a file or piped to another program
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include "Capture.h"
+#include "GLState.h"
+#include "Recorder.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define YUV_SSE2
+#endif
+
+#ifdef _WIN32
+	#define popen _popen
+	#define pclose _pclose
+	#define PIPE_MODE "wb"
+#else
+	#define PIPE_MODE "w"
+#endif
+
+namespace {
+
+const int maxPending = 6;				// converted frames awaiting the writer
+
+struct Converted {
+	vector<unsigned char> yuv;
+	int repeat = 1;						// # video frames it fills
+};
+
+struct Recorder {
+	FILE *out = NULL;
+	bool pipe = false, failed = false;
+	int width = 0, height = 0, fps = 60;
+	int nCaptured = 0, nFrames = 0;		// captures, and video frames they fill; GL thread only
+	std::chrono::steady_clock::time_point start;
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable ready, room;
+	std::map<int, Converted> pending;	// by capture number, guarded by mutex
+	vector<vector<unsigned char>> spare;// guarded by mutex
+	int nextWrite = 0;					// guarded by mutex
+	bool stop = false;					// guarded by mutex
+} recorder;
+
+// BT.601 video range, 8-bit fixed point; chroma from the mean of each 2x2 block
+
+inline unsigned char Luma(int r, int g, int b) { return (unsigned char) (((66*r+129*g+25*b+128) >> 8)+16); }
+inline unsigned char ChromaU(int r, int g, int b) { return (unsigned char) (((-38*r-74*g+112*b+128) >> 8)+128); }
+inline unsigned char ChromaV(int r, int g, int b) { return (unsigned char) (((112*r-94*g-18*b+128) >> 8)+128); }
+
+void ConvertBlocks(const unsigned char *a, const unsigned char *b, int x0, int x1,
+				   unsigned char *ya, unsigned char *yb, unsigned char *u, unsigned char *v) {
+	// rows a, b (a above) from column x0 to x1, scalar
+	for (int x = x0; x < x1; x += 2) {
+		const unsigned char *p[] = { a+4*x, a+4*x+4, b+4*x, b+4*x+4 };
+		int r = 0, g = 0, bl = 0;
+		for (int k = 0; k < 4; k++) {
+			r += p[k][0]; g += p[k][1]; bl += p[k][2];
+		}
+		ya[x] = Luma(p[0][0], p[0][1], p[0][2]);
+		ya[x+1] = Luma(p[1][0], p[1][1], p[1][2]);
+		yb[x] = Luma(p[2][0], p[2][1], p[2][2]);
+		yb[x+1] = Luma(p[3][0], p[3][1], p[3][2]);
+		r = (r+2) >> 2; g = (g+2) >> 2; bl = (bl+2) >> 2;
+		u[x/2] = ChromaU(r, g, bl);
+		v[x/2] = ChromaV(r, g, bl);
+	}
+}
+
+#ifdef YUV_SSE2
+
+void Channels(const unsigned char *rgba, __m128i &r, __m128i &g, __m128i &b) {
+	// 8 pixels, as 16-bit lanes
+	__m128i lo = _mm_loadu_si128((const __m128i *) rgba), hi = _mm_loadu_si128((const __m128i *) (rgba+16));
+	__m128i m = _mm_set1_epi32(0xff);
+	r = _mm_packs_epi32(_mm_and_si128(lo, m), _mm_and_si128(hi, m));
+	g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8), m), _mm_and_si128(_mm_srli_epi32(hi, 8), m));
+	b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 16), m), _mm_and_si128(_mm_srli_epi32(hi, 16), m));
+}
+
+__m128i Luma8(__m128i r, __m128i g, __m128i b) {
+	// sum < 65536, so unsigned 16-bit arithmetic suffices
+	__m128i s = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)), _mm_mullo_epi16(g, _mm_set1_epi16(129)));
+	s = _mm_add_epi16(s, _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(25)), _mm_set1_epi16(128)));
+	return _mm_add_epi16(_mm_srli_epi16(s, 8), _mm_set1_epi16(16));
+}
+
+__m128i Chroma8(__m128i r, __m128i g, __m128i b, short cr, short cg, short cb) {
+	// |sum| < 32768, signed
+	__m128i s = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(cr)), _mm_mullo_epi16(g, _mm_set1_epi16(cg)));
+	s = _mm_add_epi16(s, _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(cb)), _mm_set1_epi16(128)));
+	return _mm_add_epi16(_mm_srai_epi16(s, 8), _mm_set1_epi16(128));
+}
+
+__m128i Mean2x2(__m128i a0, __m128i a1, __m128i b0, __m128i b1) {
+	// 16 columns of two rows to 8 rounded means
+	__m128i one = _mm_set1_epi16(1);
+	__m128i s = _mm_packs_epi32(_mm_madd_epi16(_mm_add_epi16(a0, b0), one), _mm_madd_epi16(_mm_add_epi16(a1, b1), one));
+	return _mm_srli_epi16(_mm_add_epi16(s, _mm_set1_epi16(2)), 2);
+}
+
+#endif
+
+} // end namespace
+
+void ConvertToYUV420(const unsigned char *rgba, int stride, int width, int height,
+					 unsigned char *y, unsigned char *u, unsigned char *v, int yStride, int uvStride) {
+	for (int row = 0; row < height; row += 2) {
+		const unsigned char *a = rgba+(size_t) (height-1-row)*stride, *b = a-stride;
+		unsigned char *ya = y+(size_t) row*yStride, *yb = ya+yStride;
+		unsigned char *ur = u+(size_t) (row/2)*uvStride, *vr = v+(size_t) (row/2)*uvStride;
+		int x = 0;
+#ifdef YUV_SSE2
+		for (; x+16 <= width; x += 16) {
+			__m128i ra0, ga0, ba0, ra1, ga1, ba1, rb0, gb0, bb0, rb1, gb1, bb1;
+			Channels(a+4*x, ra0, ga0, ba0);
+			Channels(a+4*x+32, ra1, ga1, ba1);
+			Channels(b+4*x, rb0, gb0, bb0);
+			Channels(b+4*x+32, rb1, gb1, bb1);
+			_mm_storeu_si128((__m128i *) (ya+x), _mm_packus_epi16(Luma8(ra0, ga0, ba0), Luma8(ra1, ga1, ba1)));
+			_mm_storeu_si128((__m128i *) (yb+x), _mm_packus_epi16(Luma8(rb0, gb0, bb0), Luma8(rb1, gb1, bb1)));
+			__m128i r = Mean2x2(ra0, ra1, rb0, rb1), g = Mean2x2(ga0, ga1, gb0, gb1), bl = Mean2x2(ba0, ba1, bb0, bb1);
+			__m128i cu = Chroma8(r, g, bl, -38, -74, 112), cv = Chroma8(r, g, bl, 112, -94, -18);
+			_mm_storel_epi64((__m128i *) (ur+x/2), _mm_packus_epi16(cu, cu));
+			_mm_storel_epi64((__m128i *) (vr+x/2), _mm_packus_epi16(cv, cv));
+		}
+#endif
+		ConvertBlocks(a, b, x, width, ya, yb, ur, vr);
+	}
+}
+
+namespace {
+
+void Write() {
+	// write frames in order as they arrive, until stopped with none left; a lost
+	// capture (empty) is filled by repeating the frame before it, keeping the clock
+	vector<unsigned char> last;
+	for (;;) {
+		vector<unsigned char> frame;
+		int repeat = 0;
+		{
+			std::unique_lock<std::mutex> lock(recorder.mutex);
+			recorder.ready.wait(lock, [] { return recorder.stop || recorder.pending.count(recorder.nextWrite); });
+			auto f = recorder.pending.find(recorder.nextWrite);
+			if (f == recorder.pending.end())
+				return;
+			frame = std::move(f->second.yuv);
+			repeat = f->second.repeat;
+			recorder.pending.erase(f);
+			recorder.nextWrite++;
+		}
+		recorder.room.notify_all();
+		if (!frame.empty())
+			std::swap(frame, last);
+		for (int r = 0; r < repeat && !last.empty() && !recorder.failed; r++)
+			if (fputs("FRAME\n", recorder.out) < 0 || fwrite(last.data(), 1, last.size(), recorder.out) != last.size()) {
+				printf("Recorder: can't write frame (disk full, or pipe closed?)\n");
+				recorder.failed = true;		// discard the rest, rather than stall the game
+			}
+		if (!frame.empty()) {
+			std::lock_guard<std::mutex> lock(recorder.mutex);
+			recorder.spare.push_back(std::move(frame));
+		}
+	}
+}
+
+void Convert(CapturedFrame &f, int n, int repeat) {
+	// on a capture worker: crop or pad to the video size, convert, hand to the writer;
+	// a lost capture is handed on empty, so the writer doesn't wait for it forever
+	int w = recorder.width, h = recorder.height, cw = std::min(w, f.width) & ~1, ch = std::min(h, f.height) & ~1;
+	size_t ySize = (size_t) w*h, uvSize = ySize/4;
+	vector<unsigned char> yuv;
+	if (f.width) {
+		{
+			std::lock_guard<std::mutex> lock(recorder.mutex);
+			if (!recorder.spare.empty()) {
+				yuv = std::move(recorder.spare.back());
+				recorder.spare.pop_back();
+			}
+		}
+		yuv.resize(ySize+2*uvSize);
+		unsigned char *y = yuv.data(), *u = y+ySize, *v = u+uvSize;
+		if (cw < w || ch < h) {				// window shrank: black beyond it
+			memset(y, 16, ySize);
+			memset(u, 128, 2*uvSize);
+		}
+		// top ch rows of the frame
+		const unsigned char *top = f.pixels.data()+(size_t) 4*f.width*(f.height-ch);
+		ConvertToYUV420(top, 4*f.width, cw, ch, y, u, v, w, w/2);
+	}
+	std::unique_lock<std::mutex> lock(recorder.mutex);
+	// the next frame to write is always let in, so workers can't all wait on it
+	recorder.room.wait(lock, [n] { return (int) recorder.pending.size() < maxPending || n == recorder.nextWrite; });
+	Converted &c = recorder.pending[n];
+	c.yuv = std::move(yuv);
+	c.repeat = repeat;
+	lock.unlock();
+	recorder.ready.notify_one();
+}
+
+} // end namespace
+
+bool StartRecording(const char *destination, int fps) {
+	StopRecording();
+	recorder.pipe = destination[0] == '|';
+	recorder.out = recorder.pipe? popen(destination+1, PIPE_MODE) : fopen(destination, "wb");
+	if (!recorder.out) {
+		printf("StartRecording: can't open %s\n", destination);
+		return false;
+	}
+	recorder.fps = fps;
+	recorder.width = recorder.height = 0;	// set by the first frame
+	recorder.nCaptured = recorder.nFrames = recorder.nextWrite = 0;
+	recorder.failed = recorder.stop = false;
+	recorder.writer = std::thread(Write);
+	return true;
+}
+
+void RecordFrame() {
+	if (!recorder.out)
+		return;
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (!recorder.nCaptured) {
+		int4 vp = GetViewport();
+		recorder.width = vp[2] & ~1;
+		recorder.height = vp[3] & ~1;
+		recorder.start = now;
+		fprintf(recorder.out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n",
+				recorder.width, recorder.height, recorder.fps);
+	}
+	// video frames due by now, on a 1/fps clock: none if the loop is ahead of it (eg, a
+	// 144 Hz display), several (the one capture repeated) if behind, so playback is in real time
+	int due = (int) (std::chrono::duration<double>(now-recorder.start).count()*recorder.fps)+1;
+	if (due <= recorder.nFrames)
+		return;
+	int n = recorder.nCaptured++, repeat = due-recorder.nFrames;
+	recorder.nFrames = due;
+	CaptureFrame([n, repeat](CapturedFrame &f) { Convert(f, n, repeat); });
+}
+
+void StopRecording() {
+	if (!recorder.out)
+		return;
+	FinishCaptures();
+	{
+		std::lock_guard<std::mutex> lock(recorder.mutex);
+		recorder.stop = true;
+	}
+	recorder.ready.notify_one();
+	recorder.writer.join();
+	if (recorder.pipe)
+		pclose(recorder.out);
+	else
+		fclose(recorder.out);
+	recorder.out = NULL;
+	recorder.pending.clear();
+	recorder.spare.clear();
+	printf("recorded %d frames\n", recorder.nFrames);
+}
+
+bool Recording() {
+	return recorder.out != NULL;
+}
@@ -0,0 +1,31 @@
+// Recorder.h - record the window as Y4M video, to a file or piped to another program
+
+#ifndef RECORDER_HDR
+#define RECORDER_HDR
+
+// each frame is captured (see Capture.h), converted to YUV 4:2:0 (BT.601, video
+// range) on the capture workers, and written, in order, by a writer thread; if the
+// disk or pipe falls behind, a few converted frames are held and then RecordFrame
+// waits, so memory stays bounded and no frame is dropped
+
+bool StartRecording(const char *destination, int fps = 60);
+	// destination is a file (eg "Tank.y4m"), or, if it starts with '|', a command
+	// reading y4m on its standard input (eg "|ffmpeg -y -i - Tank.mp4");
+	// the video size is the viewport's at the first frame, cropped to even
+
+void RecordFrame();
+	// call after drawing, before swapping buffers; ignored unless recording; frames
+	// are taken on a 1/fps clock (skipped if called more often, repeated if less), so
+	// the video plays in real time whatever the display's refresh rate
+
+void StopRecording();
+	// write all frames recorded and close the file or pipe; call before exit, while
+	// the capture workers are still running
+
+bool Recording();
+
+void ConvertToYUV420(const unsigned char *rgba, int stride, int width, int height,
+					 unsigned char *y, unsigned char *u, unsigned char *v, int yStride, int uvStride);
+	// width and height even; rgba rows are bottom first (as glReadPixels), yuv rows top first
+
+#endif
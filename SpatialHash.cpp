@@ -0,0 +1,238 @@
+// SpatialHash.cpp - uniform-grid broadphase over axis-aligned boxes in NDC
+
+#include <float.h>
+#include <math.h>
+#include "SpatialHash.h"
+
+namespace {
+
+typedef std::unordered_multimap<Sprite *, SpatialHash *> SpriteHashes;
+
+SpriteHashes &Hashes() {
+	// sprites may be in more than one hash (eg, pellets for fish and for clicks);
+	// never destroyed, as global hashes in other files may outlive any static here
+	static SpriteHashes *hashes = new SpriteHashes;
+	return *hashes;
+}
+
+bool Overlap(vec2 min1, vec2 max1, vec2 min2, vec2 max2) {
+	return min1.x <= max2.x && min2.x <= max1.x && min1.y <= max2.y && min2.y <= max1.y;
+}
+
+} // end namespace
+
+SpatialHash::~SpatialHash() { Clear(); }
+
+int SpatialHash::Cell(float f) { return (int) floor(f/cellSize); }
+
+void SpatialHash::Bucket(int id, bool add) {
+	Box &b = boxes[id];
+	for (int y = b.y1; y <= b.y2; y++)
+		for (int x = b.x1; x <= b.x2; x++) {
+			if (add) {
+				cells[Key(x, y)].push_back(id);
+				continue;
+			}
+			auto c = cells.find(Key(x, y));
+			if (c == cells.end())
+				continue;
+			vector<int> &ids = c->second;
+			for (size_t i = 0; i < ids.size(); i++)
+				if (ids[i] == id) {
+					ids[i] = ids.back();
+					ids.pop_back();
+					break;
+				}
+			if (ids.empty())
+				cells.erase(c);
+		}
+}
+
+int SpatialHash::Insert(vec2 min, vec2 max) {
+	int id = (int) boxes.size();
+	if (freeIds.empty())
+		boxes.resize(id+1);
+	else {
+		id = freeIds.back();
+		freeIds.pop_back();
+		boxes[id] = Box();
+	}
+	boxes[id].live = true;
+	nBoxes++;
+	Update(id, min, max);
+	return id;
+}
+
+void SpatialHash::Update(int id, vec2 min, vec2 max) {
+	Box &b = boxes[id];
+	b.min = min;
+	b.max = max;
+	int x1 = Cell(min.x), y1 = Cell(min.y), x2 = Cell(max.x), y2 = Cell(max.y);
+	if (x1 == b.x1 && y1 == b.y1 && x2 == b.x2 && y2 == b.y2)
+		return;								// same cells: nothing to rebucket
+	Bucket(id, false);
+	b.x1 = x1; b.y1 = y1; b.x2 = x2; b.y2 = y2;
+	Bucket(id, true);
+}
+
+void SpatialHash::Remove(int id) {
+	if (id < 0 || id >= (int) boxes.size() || !boxes[id].live)
+		return;
+	Bucket(id, false);
+	boxes[id].live = false;
+	boxes[id].sprite = NULL;
+	freeIds.push_back(id);
+	nBoxes--;
+}
+
+void SpatialHash::QueryPoint(vec2 p, vector<int> &ids) {
+	ids.resize(0);
+	auto c = cells.find(Key(Cell(p.x), Cell(p.y)));
+	if (c != cells.end())
+		for (int id : c->second) {
+			Box &b = boxes[id];
+			if (p.x >= b.min.x && p.x <= b.max.x && p.y >= b.min.y && p.y <= b.max.y)
+				ids.push_back(id);
+		}
+}
+
+void SpatialHash::QueryAABB(vec2 min, vec2 max, vector<int> &ids) {
+	ids.resize(0);
+	stamp++;
+	int x1 = Cell(min.x), y1 = Cell(min.y), x2 = Cell(max.x), y2 = Cell(max.y);
+	if ((long long) (x2-x1+1)*(y2-y1+1) > (long long) cells.size()) {
+		// query spans more cells than are occupied: visit occupied cells instead
+		for (auto &c : cells)
+			for (int id : c.second) {
+				Box &b = boxes[id];
+				if (b.stamp != stamp && Overlap(min, max, b.min, b.max)) {
+					b.stamp = stamp;
+					ids.push_back(id);
+				}
+			}
+		return;
+	}
+	for (int y = y1; y <= y2; y++)
+		for (int x = x1; x <= x2; x++) {
+			auto c = cells.find(Key(x, y));
+			if (c == cells.end())
+				continue;
+			for (int id : c->second) {
+				Box &b = boxes[id];
+				if (b.stamp != stamp && Overlap(min, max, b.min, b.max)) {
+					b.stamp = stamp;			// a box spanning cells is reported once
+					ids.push_back(id);
+				}
+			}
+		}
+}
+
+void SpatialHash::QueryPairs(vector<int2> &pairs) {
+	pairs.resize(0);
+	for (auto &c : cells) {
+		vector<int> &ids = c.second;
+		for (size_t i = 0; i < ids.size(); i++)
+			for (size_t j = i+1; j < ids.size(); j++) {
+				Box &a = boxes[ids[i]], &b = boxes[ids[j]];
+				if (!Overlap(a.min, a.max, b.min, b.max))
+					continue;
+				// boxes sharing several cells: report the pair only in the cell
+				// holding the lower-left corner of their overlap
+				vec2 corner(a.min.x > b.min.x? a.min.x : b.min.x, a.min.y > b.min.y? a.min.y : b.min.y);
+				if (Key(Cell(corner.x), Cell(corner.y)) == c.first)
+					pairs.push_back(int2(ids[i], ids[j]));
+			}
+	}
+}
+
+void SpatialHash::Clear() {
+	for (auto &s : spriteIds) {
+		auto range = Hashes().equal_range(s.first);
+		for (auto h = range.first; h != range.second; h++)
+			if (h->second == this) {
+				Hashes().erase(h);
+				break;
+			}
+	}
+	boxes.clear();
+	freeIds.clear();
+	cells.clear();
+	spriteIds.clear();
+	nBoxes = 0;
+}
+
+// Sprites
+
+void SpriteBounds(Sprite &s, vec2 &min, vec2 &max) {
+	vec2 pts[] = { {-1,-1}, {-1,1}, {1,1}, {1,-1} };
+	min = vec2(FLT_MAX, FLT_MAX);
+	max = vec2(-FLT_MAX, -FLT_MAX);
+	for (vec2 p : pts) {
+		vec4 q = s.ptTransform*vec4(p, 0, 1);
+		min.x = q.x < min.x? q.x : min.x; max.x = q.x > max.x? q.x : max.x;
+		min.y = q.y < min.y? q.y : min.y; max.y = q.y > max.y? q.y : max.y;
+	}
+}
+
+void SpatialHash::Add(Sprite *s) {
+	if (spriteIds.find(s) != spriteIds.end())
+		return;
+	vec2 min, max;
+	SpriteBounds(*s, min, max);
+	int id = Insert(min, max);
+	boxes[id].sprite = s;
+	spriteIds[s] = id;
+	Hashes().emplace(s, this);
+}
+
+void SpatialHash::Remove(Sprite *s) {
+	auto i = spriteIds.find(s);
+	if (i == spriteIds.end())
+		return;
+	Remove(i->second);
+	spriteIds.erase(i);
+	auto range = Hashes().equal_range(s);
+	for (auto h = range.first; h != range.second; h++)
+		if (h->second == this) {
+			Hashes().erase(h);
+			break;
+		}
+}
+
+void SpatialHash::QueryPoint(vec2 p, vector<Sprite *> &sprites) {
+	QueryPoint(p, scratch);
+	sprites.resize(0);
+	for (int id : scratch)
+		sprites.push_back(boxes[id].sprite);
+}
+
+void SpatialHash::QueryAABB(vec2 min, vec2 max, vector<Sprite *> &sprites) {
+	QueryAABB(min, max, scratch);
+	sprites.resize(0);
+	for (int id : scratch)
+		sprites.push_back(boxes[id].sprite);
+}
+
+void SpatialHash::QueryPairs(vector<std::pair<Sprite *, Sprite *>> &pairs) {
+	vector<int2> ids;
+	QueryPairs(ids);
+	pairs.resize(0);
+	for (int2 p : ids)
+		pairs.push_back(std::make_pair(boxes[p.i1].sprite, boxes[p.i2].sprite));
+}
+
+void MoveSprite(Sprite *s) {
+	auto range = Hashes().equal_range(s);
+	if (range.first == range.second)
+		return;
+	vec2 min, max;
+	SpriteBounds(*s, min, max);
+	for (auto h = range.first; h != range.second; h++)
+		h->second->Update(h->second->spriteIds[s], min, max);
+}
+
+void ForgetSprite(Sprite *s) {
+	SpriteHashes &hashes = Hashes();
+	for (auto h = hashes.find(s); h != hashes.end(); h = hashes.find(s))
+		h->second->Remove(s);
+}
@@ -0,0 +1,67 @@
+// SpatialHash.h - uniform-grid broadphase over axis-aligned boxes in NDC
+
+#ifndef SPATIAL_HASH_HDR
+#define SPATIAL_HASH_HDR
+
+#include <unordered_map>
+#include <vector>
+#include "Sprite.h"
+#include "VecMat.h"
+
+using std::vector;
+
+// boxes are bucketed into every grid cell they touch; with cells about the size
+// of a typical box, inserts, moves and queries cost O(1) expected and all-pairs
+// overlap O(n) expected; results are box overlaps only (callers test exactly)
+
+class SpatialHash {
+public:
+	SpatialHash(float cellSize = .2f) : cellSize(cellSize) { }
+	~SpatialHash();
+	// boxes, by id
+	int Insert(vec2 min, vec2 max);
+		// return id
+	void Update(int id, vec2 min, vec2 max);
+	void Remove(int id);
+	void QueryPoint(vec2 p, vector<int> &ids);
+	void QueryAABB(vec2 min, vec2 max, vector<int> &ids);
+	void QueryPairs(vector<int2> &pairs);
+	// sprites: box is the bounds of ptTransform, kept current by Sprite::UpdateTransform
+	void Add(Sprite *s);
+	void Remove(Sprite *s);
+	void QueryPoint(vec2 p, vector<Sprite *> &sprites);
+	void QueryAABB(vec2 min, vec2 max, vector<Sprite *> &sprites);
+	void QueryPairs(vector<std::pair<Sprite *, Sprite *>> &pairs);
+	void Clear();
+	int Size() { return nBoxes; }
+private:
+	struct Box {
+		vec2 min, max;
+		int x1 = 0, y1 = 0, x2 = -1, y2 = -1;	// cell range
+		Sprite *sprite = NULL;
+		unsigned int stamp = 0;					// last query to report this box
+		bool live = false;
+	};
+	float cellSize;
+	vector<Box> boxes;
+	vector<int> freeIds;
+	int nBoxes = 0;
+	unsigned int stamp = 0;
+	std::unordered_map<long long, vector<int>> cells;
+	std::unordered_map<Sprite *, int> spriteIds;
+	vector<int> scratch;
+	int Cell(float f);
+	long long Key(int x, int y) { return (long long) ((unsigned long long) (unsigned int) x << 32 | (unsigned int) y); }
+	void Bucket(int id, bool add);
+	friend void MoveSprite(Sprite *s);
+};
+
+void SpriteBounds(Sprite &s, vec2 &min, vec2 &max);
+
+void MoveSprite(Sprite *s);
+	// update s in any SpatialHash that holds it; called by Sprite::UpdateTransform
+
+void ForgetSprite(Sprite *s);
+	// remove s from any SpatialHash that holds it; called by Sprite::Release
+
+#endif
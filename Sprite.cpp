@@ -1,10 +1,15 @@
 // Sprite.cpp
 // Copyright (c) 2024 Jules Bloomenthal, all rights reserved. Commercial use requires license.
 
+#include "AlphaMask.h"
+#include "Atlas.h"
 #include "Draw.h"
+#include "GLState.h"
 #include "GLXtras.h"
 #include "IO.h"
+#include "SpatialHash.h"
 #include "Sprite.h"
+#include "TextureCache.h"
 #include <algorithm>
 
 // Shader storage buffers for collision tests
@@ -37,12 +42,23 @@ int BuildSpriteShader(bool collisionTest = false) {
 		uniform sampler2D textureImage, textureMat;
 		uniform bool useMat;
 		uniform int nTexChannels = 3;
+		uniform vec4 atlasRect = vec4(0);	// if zw non-zero, region of textureImage
+		uniform sampler2DArray textureArray;
+		uniform int layer = -1;				// if non-negative, layer of textureArray
+		vec4 Texel(vec2 st) {
+			if (layer >= 0)
+				return texture(textureArray, vec3(st, layer));
+			if (atlasRect.z == 0)
+				return texture(textureImage, st);
+			// wrap within the region, as GL_REPEAT would for a texture of its own
+			return textureGrad(textureImage, atlasRect.xy+fract(st)*atlasRect.zw, dFdx(st)*atlasRect.zw, dFdy(st)*atlasRect.zw);
+		}
 		void main() {
 			vec2 st = (uvTransform*vec4(uv, 0, 1)).xy;
 			if (nTexChannels == 4)
-				pColor = texture(textureImage, st);
+				pColor = Texel(st);
 			else {
-				pColor.rgb = texture(textureImage, st).rgb;
+				pColor.rgb = Texel(st).rgb;
 				pColor.a = useMat? texture(textureMat, st).r : 1;
 			}
 			if (pColor.a < .02) // if nearly full matte,
@@ -62,12 +78,23 @@ int BuildSpriteShader(bool collisionTest = false) {
 		uniform sampler2D textureImage, textureMat;
 		uniform mat4 uvTransform;
 		uniform int spriteId = 0, nTexChannels = 3;
+		uniform int collideStride = 0;										// 0: one row, else row per sprite
+		uniform vec4 atlasRect = vec4(0);									// if zw non-zero, region of textureImage
+		uniform sampler2DArray textureArray;
+		uniform int layer = -1;												// if non-negative, layer of textureArray
+		vec4 Texel(vec2 st) {
+			if (layer >= 0)
+				return texture(textureArray, vec3(st, layer));
+			if (atlasRect.z == 0)
+				return texture(textureImage, st);
+			return textureGrad(textureImage, atlasRect.xy+fract(st)*atlasRect.zw, dFdx(st)*atlasRect.zw, dFdy(st)*atlasRect.zw);
+		}
 		void main() {
 			vec2 st = (uvTransform*vec4(uv, 0, 1)).xy;
 			if (nTexChannels == 4)
-				pColor = texture(textureImage, st);
+				pColor = Texel(st);
 			else {
-				pColor.rgb = texture(textureImage, st).rgb;
+				pColor.rgb = Texel(st).rgb;
 				pColor.a = useMat? texture(textureMat, st).r : 1;
 			}
 			if (pColor.a < .02) // if nearly full matte, don't tag z-buffer
@@ -79,7 +106,7 @@ int BuildSpriteShader(bool collisionTest = false) {
 				int id = int((gl_FragCoord.y-vp[1])*vp[2]+gl_FragCoord.x-vp[0]);
 				int o = occupy[id];
 				if (o > -1) {
-					collide[o] = 1;
+					collide[spriteId*collideStride+o] = 1;
 					atomicCounterIncrement(counter);
 					if (showOccupy)
 						pColor = vec4(cols[(o+spriteId) % 12], 1);
@@ -103,8 +130,29 @@ GLuint GetCollisionShader() {
 	return spriteCollisionShader;
 }
 
-bool CrossPositive(vec2 a, vec2 b, vec2 c) {
-	return cross(vec2(b-a), vec2(c-b)) > 0;
+// uniform locations, resolved once per shader rather than per Display
+struct SpriteUniforms {
+	GLuint program = 0;
+	GLint nTexChannels = -1, textureImage = -1, textureMat = -1, useMat = -1, z = -1, view = -1, uvTransform = -1, atlasRect = -1;
+	GLint textureArray = -1, layer = -1;
+} spriteUniforms, collisionUniforms;
+
+SpriteUniforms &GetUniforms(GLuint program) {
+	SpriteUniforms &u = program == spriteCollisionShader? collisionUniforms : spriteUniforms;
+	if (u.program != program) {
+		u.program = program;
+		u.nTexChannels = UniformLocation(program, "nTexChannels");
+		u.textureImage = UniformLocation(program, "textureImage");
+		u.textureMat = UniformLocation(program, "textureMat");
+		u.useMat = UniformLocation(program, "useMat");
+		u.z = UniformLocation(program, "z");
+		u.view = UniformLocation(program, "view");
+		u.uvTransform = UniformLocation(program, "uvTransform");
+		u.atlasRect = UniformLocation(program, "atlasRect");
+		u.textureArray = UniformLocation(program, "textureArray");
+		u.layer = UniformLocation(program, "layer");
+	}
+	return u;
 }
 
 } // end namespace
@@ -180,37 +228,151 @@ void GetCollided(int nsprites, Sprite *s) {
 
 bool ZCompare(Sprite *s1, Sprite *s2) { return s1->z > s2->z; }
 
-int TestCollisions(vector<Sprite *> &sprites) {
+void DisplayForCollision(vector<Sprite *> &sprites, int collideStride, bool readEach) {
+	// display in descending z order, each sprite tagging occupancy and collisions
 	int nsprites = sprites.size();
-	if (nsprites != nCollisionSprites) {
-		nCollisionSprites = nsprites;
-		InitCollisionShaderStorage(nsprites);
-	}
-	// else
-		ClearOccupyAndCounter(nsprites);
 	vector<Sprite *> tmp = sprites;
 	for (int i = 0; i < nsprites; i++)
 		tmp[i]->id = i;
 	sort(tmp.begin(), tmp.end(), ZCompare);
 	GLuint program = SpriteSpace::GetCollisionShader();
-	glUseProgram(program);
+	UseProgram(program);
 	vec4 vp = VP();
 	SetUniform(program, "vp", vp);
 	SetUniform(program, "showOccupy", true);
-	// display in descending z order
+	SetUniform(program, "collideStride", collideStride);
+	GLint spriteId = UniformLocation(program, "spriteId");
 	for (int i = 0; i < nsprites; i++) {
 		Sprite *s = tmp[i];
-		SetUniform(program, "spriteId", s->id);
-		ClearCollide();
+		SetUniform(spriteId, s->id);
+		if (readEach)
+			ClearCollide();
 		s->Display();
-		GetCollided(nsprites, s);
+		if (readEach)
+			GetCollided(nsprites, s);
+		else
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT); // next sprite sees this one's occupancy
 	}
 	SetUniform(program, "showOccupy", false);
 	UseDrawShader(ScreenMode());
-	glUseProgram(0);
+	UseProgram(0);
+}
+
+int TestCollisions(vector<Sprite *> &sprites) {
+	int nsprites = sprites.size();
+	if (nsprites != nCollisionSprites) {
+		nCollisionSprites = nsprites;
+		InitCollisionShaderStorage(nsprites);
+	}
+	// else
+		ClearOccupyAndCounter(nsprites);
+	DisplayForCollision(sprites, 0, true);
 	return ReadCounter();
 }
 
+#ifdef GL_VERSION_4_4
+
+// asynchronous collision: alternate frames use separate buffers, cleared on the GPU;
+// results are copied to a persistently mapped buffer and read once its fence signals
+
+struct CollisionFrame {
+	GLuint occupy = 0, collide = 0, counter = 0, readback = 0;
+	int *mapped = NULL;				// nSprites*nSprites collide flags, then pixel count
+	size_t nFlags = 0;				// nSprites*nSprites
+	int nPixels = -1, nSprites = -1;
+	GLsync fence = NULL;
+	vector<Sprite *> sprites;		// as submitted, indexed by id
+};
+
+CollisionFrame collisionFrames[2];
+int collisionFrame = 0, asyncCollisionCount = 0;
+
+void AllocateCollisionFrame(CollisionFrame &f, int nPixels, int nSprites) {
+	if (f.readback) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, f.readback);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		GLuint buffers[] = { f.occupy, f.collide, f.counter, f.readback };
+		glDeleteBuffers(4, buffers);
+	}
+	// f's fence has been harvested (or abandoned), so the GPU is done with these
+	f.nPixels = nPixels;
+	f.nSprites = nSprites;
+	f.nFlags = (size_t) nSprites*nSprites;
+	GLsizeiptr size = (f.nFlags+1)*sizeof(int);
+	GLuint buffers[4];
+	glGenBuffers(4, buffers);
+	f.occupy = buffers[0]; f.collide = buffers[1]; f.counter = buffers[2]; f.readback = buffers[3];
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, f.occupy);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, (size_t) nPixels*sizeof(int), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, f.collide);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, f.counter);
+	glBufferData(GL_ATOMIC_COUNTER_BUFFER, sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+	GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glBindBuffer(GL_COPY_WRITE_BUFFER, f.readback);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+	f.mapped = (int *) glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+bool HarvestCollisionFrame(CollisionFrame &f, vector<Sprite *> &sprites, GLuint64 timeout) {
+	// copy results to those sprites still at the index they were submitted with
+	if (!f.fence)
+		return false;
+	GLenum r = glClientWaitSync(f.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+	if (r == GL_TIMEOUT_EXPIRED)
+		return false;					// still in flight: f must not be reused yet
+	glDeleteSync(f.fence);
+	f.fence = NULL;
+	if (r == GL_WAIT_FAILED)
+		return false;					// results lost, but f is free
+	size_t n = f.nSprites;
+	for (size_t i = 0; i < n && i < sprites.size(); i++)
+		if (sprites[i] == f.sprites[i])
+			sprites[i]->collided.assign(f.mapped+i*n, f.mapped+(i+1)*n);
+	asyncCollisionCount = f.mapped[f.nFlags];
+	return true;
+}
+
+int TestCollisionsAsync(vector<Sprite *> &sprites) {
+	CollisionFrame &f = collisionFrames[collisionFrame], &last = collisionFrames[1-collisionFrame];
+	// f was submitted two frames ago; finish with it before its buffers are reused
+	HarvestCollisionFrame(f, sprites, 1000000000);
+	HarvestCollisionFrame(last, sprites, 0);
+	if (f.fence)
+		return asyncCollisionCount;		// GPU a second behind: skip this frame, submit into f later
+	int nsprites = sprites.size(), nPixels = VPw()*VPh();
+	if (f.nPixels != nPixels || f.nSprites != nsprites)
+		AllocateCollisionFrame(f, nPixels, nsprites);
+	f.sprites = sprites;
+	int clearInt = -1;
+	GLuint clearCount = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, f.occupy);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32I, GL_RED_INTEGER, GL_INT, &clearInt);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, f.collide);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32I, GL_RED_INTEGER, GL_INT, &clearInt);
+	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, f.counter);
+	glClearBufferData(GL_ATOMIC_COUNTER_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &clearCount);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, occupyBinding, f.occupy);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, collideBinding, f.collide);
+	glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, f.counter);
+	DisplayForCollision(sprites, nsprites, false);
+	// copy collide flags and count for the CPU, fence
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_ATOMIC_COUNTER_BARRIER_BIT);
+	glBindBuffer(GL_COPY_READ_BUFFER, f.collide);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, f.readback);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, f.nFlags*sizeof(int));
+	glBindBuffer(GL_COPY_READ_BUFFER, f.counter);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, f.nFlags*sizeof(int), sizeof(GLuint));
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	f.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	collisionFrame = 1-collisionFrame;
+	return asyncCollisionCount;
+}
+
+#endif // GL_VERSION_4_4
+
 #endif
 
 bool Intersect(mat4 m1, mat4 m2) {
@@ -236,39 +398,42 @@ void Sprite::Initialize(GLuint texName, float z) {
 	this->z = z;
 	textureName = texName;
 	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+	BindVertexArray(vao);
 	UpdateTransform();
 }
 
 void Sprite::Initialize(string imageFile, float z, bool compensateAspectRatio) {
 	this->z = z;
 	this->compensateAspectRatio = compensateAspectRatio;
-	ReadTexture(imageFile.c_str(), &textureName, true, &nTexChannels, &imgWidth, &imgHeight);
+	textureName = CacheTexture(imageFile.c_str(), true, &nTexChannels, &imgWidth, &imgHeight);
 	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+	BindVertexArray(vao);
 	UpdateTransform();
 }
 
 void Sprite::Initialize(string imageFile, string matFile, float z) {
 	Initialize(imageFile, z);
-	ReadTexture(matFile.c_str(), &matName);
+	matName = CacheTexture(matFile.c_str());
 }
 
 void Sprite::Initialize(vector<string> &imageFiles, string matFile, float z, float frameDuration) {
 	this->z = z;
 	nFrames = imageFiles.size();
 	images.resize(nFrames);
+	// prefer one texture array for all frames, else a texture per frame
+	vector<GLuint> layerNames;
+	int nArrayChannels = 0;
+	bool array = CacheTextureArray(imageFiles, layerNames, &nArrayChannels) > 0;
 	for (int i = 0; i < nFrames; i++) {
-		int nTexChannels;
-		GLuint textureName;
-		ReadTexture(imageFiles[i].c_str(), &textureName, true, &nTexChannels);
+		int nTexChannels = nArrayChannels;
+		GLuint textureName = array? layerNames[i] : CacheTexture(imageFiles[i].c_str(), true, &nTexChannels);
 		images[i] = ImageInfo(textureName, nTexChannels, frameDuration);
 	}
 	if (!matFile.empty())
-		ReadTexture(matFile.c_str(), &matName);
+		matName = CacheTexture(matFile.c_str());
 	change = clock()+(time_t)(frameDuration*CLOCKS_PER_SEC);
 	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+	BindVertexArray(vao);
 	UpdateTransform();
 }
 
@@ -277,7 +442,7 @@ void Sprite::InitializeGIF(string gifFile, float z) {
 	vector<GLuint> textureNames;
 	vector<float> frameDurations;
 	this->z = z;
-	nFrames = ReadGIF(gifFile.c_str(), textureNames, &nChannels, &frameDurations);
+	nFrames = CacheGIF(gifFile.c_str(), textureNames, &nChannels, &frameDurations);
 	images.resize(nFrames);
 	for (int i = 0; i < nFrames; i++)
 		images[i] = ImageInfo(textureNames[i], nChannels, frameDurations[i]);
@@ -285,17 +450,8 @@ void Sprite::InitializeGIF(string gifFile, float z) {
 }
 
 bool Sprite::Hit(double x, double y) {
-	// test against z-buffer
-	float depth;
-	if (DepthXY((int) x, (int) y, depth))
-		return abs(depth-z) < .01;
-	// test against quad
-	vec2 test = NDCfromScreen(x, y);
-	vec2 xPts[] = { PtTransform({-1,-1}), PtTransform({-1,1}), PtTransform({1,1}), PtTransform({1,-1}) };
-	for (int i = 0; i < 4; i++)
-		if (SpriteSpace::CrossPositive(test, xPts[i], xPts[(i+1)%4]))
-			return false;
-	return true;
+	// test against quad and CPU alpha mask (occlusion by other sprites is the caller's concern)
+	return SpriteHit(*this, NDCfromScreen(x, y));
 }
 
 void Sprite::SetRotation(float angle) { rotation = angle; UpdateTransform(); }
@@ -318,6 +474,7 @@ void Sprite::UpdateTransform() {
 		vec3 scale = w > h? vec3(h/w, 1.f, 1.f) : vec3(1.f, w/h, 1.f);
 		ptTransform = Scale(scale)*ptTransform;
 	}
+	MoveSprite(this);
 }
 
 vec2 Sprite::PtTransform(vec2 p) {
@@ -355,7 +512,7 @@ void Sprite::SetScale(vec2 s) {
 	UpdateTransform();
 }
 
-void Sprite::SetPtTransform(mat4 m) { ptTransform = m; }
+void Sprite::SetPtTransform(mat4 m) { ptTransform = m; MoveSprite(this); }
 
 void Sprite::SetUvTransform(mat4 m) { uvTransform = m; }
 
@@ -382,11 +539,12 @@ void Sprite::SetFrame(int n) {
 
 void Sprite::Display(mat4 *fullview, int textureUnit) {
 	int s = CurrentProgram();
-	glBindVertexArray(vao);
+	BindVertexArray(vao);
 	if (s <= 0 || (s != spriteShader && s != spriteCollisionShader))
 		s = SpriteSpace::GetShader();
-	glUseProgram(s);
-	glActiveTexture(GL_TEXTURE0+textureUnit);
+	UseProgram(s);
+	SpriteSpace::SpriteUniforms &u = SpriteSpace::GetUniforms(s);
+	GLuint name = textureName;
 	if (nFrames) {
 		time_t now = clock();
 		ImageInfo i = images[frame];
@@ -394,23 +552,29 @@ void Sprite::Display(mat4 *fullview, int textureUnit) {
 			frame = (frame+1)%nFrames;
 			change = now+(time_t)(i.duration*CLOCKS_PER_SEC);
 		}
-		glBindTexture(GL_TEXTURE_2D, i.textureName);
-		SetUniform(s, "nTexChannels", i.nChannels);
+		name = i.textureName;
+		SetUniform(u.nTexChannels, i.nChannels);
 	}
-	else {
-		glBindTexture(GL_TEXTURE_2D, textureName);
-		SetUniform(s, "nTexChannels", nTexChannels);
-	}
-	SetUniform(s, "textureImage", textureUnit);
-	SetUniform(s, "useMat", matName > 0);
-	SetUniform(s, "z", z);
+	else
+		SetUniform(u.nTexChannels, nTexChannels);
+	// frames of an array share one texture, bound to its own unit; advancing a frame changes only the layer
+	TextureBinding b = ResolveTexture(name);
+	bool array = b.target == GL_TEXTURE_2D_ARRAY;
+	ActiveTexture(GL_TEXTURE0+textureUnit+(array? 2 : 0));
+	BindTexture(b.target, b.texture);
+	SetUniform(u.atlasRect, b.rect);
+	SetUniform(u.layer, array? b.layer : -1);
+	SetUniform(u.textureArray, (int) textureUnit+2);
+	SetUniform(u.textureImage, textureUnit);
+	SetUniform(u.useMat, matName > 0);
+	SetUniform(u.z, z);
 	if (matName > 0) {
-		glActiveTexture(GL_TEXTURE0+textureUnit+1);
-		glBindTexture(GL_TEXTURE_2D, matName);
-		SetUniform(s, "textureMat", (int) textureUnit+1);
+		ActiveTexture(GL_TEXTURE0+textureUnit+1);
+		BindTexture(GL_TEXTURE_2D, ResolveTexture(matName).texture);
+		SetUniform(u.textureMat, (int) textureUnit+1);
 	}
-	SetUniform(s, "view", fullview? *fullview*ptTransform : ptTransform);
-	SetUniform(s, "uvTransform", uvTransform);
+	SetUniform(u.view, fullview? *fullview*ptTransform : ptTransform);
+	SetUniform(u.uvTransform, uvTransform);
 #ifdef GL_QUADS
 // #ifndef __APPLE__
 	glDrawArrays(GL_QUADS, 0, 4);
@@ -424,11 +588,28 @@ void Sprite::SetFrameDuration(float dt) {
 		i.duration = dt;
 }
 
+bool Sprite::Ready() {
+	// names from an asynchronous TextureCache show a placeholder until loaded
+	if (!TextureReady(textureName) || !TextureReady(matName))
+		return false;
+	for (const ImageInfo &i : images)
+		if (!TextureReady(i.textureName))
+			return false;
+	return true;
+}
+
 void Sprite::Release() {
+	// textures are shared via the cache; those given to Initialize(GLuint) are the caller's
 	if (textureName > 0)
-		glDeleteBuffers(1, &textureName);
+		ReleaseTexture(textureName);
 	if (matName > 0)
-		glDeleteBuffers(1, &matName);
+		ReleaseTexture(matName);
 	for (const ImageInfo &i : images)
-		glDeleteBuffers(1, &i.textureName);
+		ReleaseTexture(i.textureName);
+	if (vao > 0)
+		DeleteVertexArrays(1, &vao);
+	textureName = matName = vao = 0;
+	images.resize(0);
+	nFrames = 0;
+	ForgetSprite(this);
 }
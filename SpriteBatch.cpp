@@ -0,0 +1,218 @@
+// SpriteBatch.cpp - instanced display of many sprites
+
+#include <glad.h>
+#include <algorithm>
+#include <stddef.h>
+#include <time.h>
+#include "Atlas.h"
+#include "GLState.h"
+#include "GLXtras.h"
+#include "SpriteBatch.h"
+
+namespace {
+
+GLuint batchShader = 0;
+GLint nTexChannelsId = -1, useMatId = -1, textureImageId = -1, textureMatId = -1, textureArrayId = -1;
+
+// per-instance attributes: view matrix rows (0-3), uv matrix rows (4-5), z (6), atlas rect (7), array layer (8)
+const char *batchVShader = R"(
+	#version 330
+	layout(location = 0) in vec4 view0;
+	layout(location = 1) in vec4 view1;
+	layout(location = 2) in vec4 view2;
+	layout(location = 3) in vec4 view3;
+	layout(location = 4) in vec4 uv0;
+	layout(location = 5) in vec4 uv1;
+	layout(location = 6) in float z;
+	layout(location = 7) in vec4 atlasRect;
+	layout(location = 8) in int arrayLayer;
+	out vec2 uv;
+	flat out vec4 rect;
+	flat out int layer;
+	void main() {
+		// works for 2 tris
+		const vec2 pts[6] = vec2[6](vec2(-1,-1), vec2(1,-1), vec2(1,1), vec2(-1,1), vec2(-1,-1), vec2(1,1));
+		vec2 p = pts[gl_VertexID];
+		vec4 t = vec4((vec2(1,1)+p)/2, 0, 1), q = vec4(p, z, 1);
+		uv = vec2(dot(uv0, t), dot(uv1, t));		// uv transform is affine, so ok per vertex
+		rect = atlasRect;
+		layer = arrayLayer;
+		gl_Position = vec4(dot(view0, q), dot(view1, q), dot(view2, q), dot(view3, q));
+	}
+)";
+
+const char *batchPShader = R"(
+	#version 330
+	in vec2 uv;
+	flat in vec4 rect;
+	flat in int layer;
+	out vec4 pColor;
+	uniform sampler2D textureImage, textureMat;
+	uniform sampler2DArray textureArray;
+	uniform bool useMat;
+	uniform int nTexChannels = 3;
+	vec4 Texel(vec2 st) {
+		// as in the sprite shader: sample array layer, or wrap within an atlas region
+		if (layer >= 0)
+			return texture(textureArray, vec3(st, layer));
+		if (rect.z == 0)
+			return texture(textureImage, st);
+		return textureGrad(textureImage, rect.xy+fract(st)*rect.zw, dFdx(st)*rect.zw, dFdy(st)*rect.zw);
+	}
+	void main() {
+		if (nTexChannels == 4)
+			pColor = Texel(uv);
+		else {
+			pColor.rgb = Texel(uv).rgb;
+			pColor.a = useMat? texture(textureMat, uv).r : 1;
+		}
+		if (pColor.a < .02) // if nearly full matte,
+			discard;		// don't tag z-buffer
+	}
+)";
+
+GLuint GetBatchShader() {
+	if (!batchShader) {
+		batchShader = LinkProgramViaCode(&batchVShader, &batchPShader);
+		nTexChannelsId = UniformLocation(batchShader, "nTexChannels");
+		useMatId = UniformLocation(batchShader, "useMat");
+		textureImageId = UniformLocation(batchShader, "textureImage");
+		textureMatId = UniformLocation(batchShader, "textureMat");
+		textureArrayId = UniformLocation(batchShader, "textureArray");
+	}
+	return batchShader;
+}
+
+void CurrentImage(Sprite &s, GLuint &textureName, int &nChannels) {
+	// as in Sprite::Display, advance animated sprites
+	if (s.nFrames) {
+		time_t now = clock();
+		ImageInfo i = s.images[s.frame];
+		if (s.autoAnimate && now > s.change) {
+			s.frame = (s.frame+1)%s.nFrames;
+			s.change = now+(time_t)(i.duration*CLOCKS_PER_SEC);
+		}
+		textureName = i.textureName;
+		nChannels = i.nChannels;
+	}
+	else {
+		textureName = s.textureName;
+		nChannels = s.nTexChannels;
+	}
+}
+
+} // end namespace
+
+SpriteBatch::Group &SpriteBatch::FindGroup(GLuint textureName, GLenum target, GLuint matName, int nChannels) {
+	// few distinct textures per frame, so linear search suffices
+	for (Group &g : groups)
+		if (g.textureName == textureName && g.target == target && g.matName == matName && g.nChannels == nChannels)
+			return g;
+	groups.resize(groups.size()+1);
+	Group &g = groups.back();
+	g.textureName = textureName;
+	g.target = target;
+	g.matName = matName;
+	g.nChannels = nChannels;
+	return g;
+}
+
+void SpriteBatch::Add(Sprite &s, mat4 *fullview) {
+	Add(s, s.ptTransform, fullview);
+}
+
+void SpriteBatch::Add(Sprite &s, mat4 ptTransform, mat4 *fullview) {
+	GLuint textureName = 0;
+	int nChannels = 3;
+	CurrentImage(s, textureName, nChannels);
+	mat4 m = fullview? *fullview*ptTransform : ptTransform;
+	SpriteInstance inst;
+	for (int i = 0; i < 4; i++)
+		inst.view[i] = m[i];
+	inst.uv[0] = s.uvTransform[0];
+	inst.uv[1] = s.uvTransform[1];
+	inst.z = s.z;
+	TextureBinding b = ResolveTexture(textureName);
+	inst.atlasRect = b.rect;
+	inst.layer = b.layer;
+	FindGroup(b.texture, b.target, s.matName, nChannels).instances.push_back(inst);
+	nInstances++;
+}
+
+void SpriteBatch::Clear() {
+	// drop groups unused this frame, retain storage of the others
+	groups.erase(std::remove_if(groups.begin(), groups.end(), [](Group &g) { return g.instances.empty(); }), groups.end());
+	for (Group &g : groups)
+		g.instances.resize(0);
+	nInstances = 0;
+}
+
+void SpriteBatch::Display(int textureUnit) {
+	if (!nInstances)
+		return;
+	GLuint program = GetBatchShader();
+	if (!vao) {
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(1, &vbo);
+	}
+	BindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	// concatenate groups, upload once
+	upload.resize(0);
+	for (Group &g : groups)
+		upload.insert(upload.end(), g.instances.begin(), g.instances.end());
+	size_t size = upload.size()*sizeof(SpriteInstance);
+	if (size > vboSize)
+		vboSize = 2*size;
+	glBufferData(GL_ARRAY_BUFFER, vboSize, NULL, GL_STREAM_DRAW); // orphan last frame's instances
+	glBufferSubData(GL_ARRAY_BUFFER, 0, size, upload.data());
+	for (GLuint a = 0; a < 9; a++) {
+		glEnableVertexAttribArray(a);
+		glVertexAttribDivisor(a, 1);
+	}
+	UseProgram(program);
+	SetUniform(textureImageId, textureUnit);
+	SetUniform(textureMatId, textureUnit+1);
+	SetUniform(textureArrayId, textureUnit+2);
+	int start = 0;
+	for (Group &g : groups) {
+		int n = (int) g.instances.size();
+		if (!n)
+			continue;
+		// point attributes at this group's instances
+		GLsizei stride = sizeof(SpriteInstance);
+		char *base = (char *) (start*sizeof(SpriteInstance));
+		for (GLuint a = 0; a < 4; a++)
+			glVertexAttribPointer(a, 4, GL_FLOAT, GL_FALSE, stride, base+a*sizeof(vec4));
+		for (GLuint a = 0; a < 2; a++)
+			glVertexAttribPointer(4+a, 4, GL_FLOAT, GL_FALSE, stride, base+(4+a)*sizeof(vec4));
+		glVertexAttribPointer(6, 1, GL_FLOAT, GL_FALSE, stride, base+6*sizeof(vec4));
+		glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, stride, base+offsetof(SpriteInstance, atlasRect));
+		glVertexAttribIPointer(8, 1, GL_INT, stride, base+offsetof(SpriteInstance, layer));
+		// arrays bind to their own unit, so a 2D sampler never sees an array texture
+		bool array = g.target == GL_TEXTURE_2D_ARRAY;
+		ActiveTexture(GL_TEXTURE0+textureUnit+(array? 2 : 0));
+		BindTexture(g.target, g.textureName);
+		if (g.matName > 0) {
+			ActiveTexture(GL_TEXTURE0+textureUnit+1);
+			BindTexture(GL_TEXTURE_2D, ResolveTexture(g.matName).texture);
+		}
+		SetUniform(nTexChannelsId, g.nChannels);
+		SetUniform(useMatId, g.matName > 0);
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 6, n);
+		start += n;
+	}
+	BindVertexArray(0);
+	Clear();
+}
+
+void SpriteBatch::Release() {
+	if (vbo > 0)
+		glDeleteBuffers(1, &vbo);
+	if (vao > 0)
+		DeleteVertexArrays(1, &vao);
+	vao = vbo = 0;
+	vboSize = 0;
+	groups.clear();
+	nInstances = 0;
+}
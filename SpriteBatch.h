@@ -0,0 +1,51 @@
+// SpriteBatch.h - instanced display of many sprites
+
+#ifndef SPRITE_BATCH_HDR
+#define SPRITE_BATCH_HDR
+
+#include <glad.h>
+#include <vector>
+#include "Sprite.h"
+#include "VecMat.h"
+
+using std::vector;
+
+// a SpriteBatch collects sprites during a frame, then displays them with one
+// instanced draw per (texture, matte, #channels) group, rather than one
+// fully state-changed draw per sprite; sprites are grouped in order of first use,
+// and sprites whose images share an atlas page or texture array share a group
+
+struct SpriteInstance {
+	vec4 view[4];		// rows of fullview*ptTransform
+	vec4 uv[2];			// first two rows of uvTransform
+	float z = 0;
+	vec4 atlasRect;		// region of the group's texture, or (0,0,0,0) if whole
+	int layer = -1;		// layer of the group's texture array, or -1 if 2D texture
+};
+
+class SpriteBatch {
+public:
+	void Add(Sprite &s, mat4 *fullview = NULL);
+	void Add(Sprite &s, mat4 ptTransform, mat4 *fullview = NULL);
+		// second form overrides s.ptTransform (eg, many instances of one sprite)
+	void Display(int textureUnit = 0);
+		// draw and clear the collected sprites
+	void Clear();
+	int Size() { return nInstances; }
+	void Release();
+private:
+	struct Group {
+		GLuint textureName = 0, matName = 0;
+		GLenum target = GL_TEXTURE_2D;
+		int nChannels = 3;
+		vector<SpriteInstance> instances;
+	};
+	vector<Group> groups;
+	vector<SpriteInstance> upload;
+	int nInstances = 0;
+	GLuint vao = 0, vbo = 0;
+	size_t vboSize = 0;
+	Group &FindGroup(GLuint textureName, GLenum target, GLuint matName, int nChannels);
+};
+
+#endif
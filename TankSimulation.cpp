@@ -0,0 +1,157 @@
+// TankSimulation.cpp - fixed-timestep fish tank simulation, independent of display
+
+#include <algorithm>
+#include <math.h>
+#include "TankSimulation.h"
+
+namespace {
+
+// speeds (NDC per second) are the original per-frame deltas at 60 frames per second
+const float swimSpeed = .3f, maxX = 1.45f, maxFishY = .8f;
+const double maxFrameTime = .25;	// after a stall, drop time rather than spiral
+
+struct CreatureStart { vec2 position, velocity, scale; float frameDuration; };
+
+const CreatureStart starts[] = {
+	{ vec2(0.f, 0.f), vec2(.3f, .3f), vec2(.3f, .3f), .25f },		// KIND_FISH
+	{ vec2(-1.4f, -.7f), vec2(.06f, 0.f), vec2(.4f, .4f), .5f },	// KIND_SNAIL
+	{ vec2(1.f, .6f), vec2(.18f, 0.f), vec2(.4f, .4f), .5f },		// KIND_REDFISH
+	{ vec2(-.6f, -.1f), vec2(-.12f, 0.f), vec2(.4f, .4f), .5f },	// KIND_GOLDFISH
+};
+
+} // end namespace
+
+TankSimulation::TankSimulation(unsigned int seed) : rng(seed) {
+	AddCreature(KIND_FISH);
+}
+
+int TankSimulation::AddCreature(EntityKind k) {
+	const CreatureStart &s = starts[k];
+	return entities.Create(k, s.position, s.velocity, s.scale, 2, s.frameDuration);
+}
+
+float TankSimulation::Random(float min, float max) {
+	return std::uniform_real_distribution<float>(min, max)(rng);
+}
+
+float TankSimulation::Advance(double seconds) {
+	accumulator += std::min(seconds, maxFrameTime);
+	while (accumulator >= dt) {
+		Step();
+		accumulator -= dt;
+	}
+	return (float) (accumulator/dt);
+}
+
+void TankSimulation::Step() {
+	SavePositions(entities);
+	time += dt;
+	// every second, income per fish; every 15 seconds, a mess somewhere in the tank
+	for (incomeTime += dt; incomeTime >= 1; incomeTime -= 1)
+		money += numFish*.05;
+	for (messTime += dt; messTime >= 15; messTime -= 15) {
+		int id = entities.Create(KIND_MESS, vec2(Random(-1, 1), Random(-1, 1)));
+		nMessesSpawned++;
+		if (itemAdded)
+			itemAdded(*this, id);
+	}
+	Feed();
+	if (schooling) {
+		int food = entities.Index(entities.First(KIND_PELLET));
+		vec2 target = food >= 0? entities.Position(food) : vec2(0.f, 0.f);
+		flock.Steer(entities, dt, vec2(maxX, maxFishY), feeding && food >= 0? &target : NULL, &pool);
+	}
+	turns.resize(0);
+	Swim(entities, dt, maxX, maxFishY, turns);
+	Animate(entities, dt);
+}
+
+bool TankSimulation::Aim(int i) {
+	// set motion of lone fish i for this step; return true if it may eat
+	Entities &e = entities;
+	if (!feeding) {
+		if (e.motion[i] != PATROL) {
+			// resume wandering
+			e.vx[i] = e.wx[i];
+			e.vy[i] = e.wy[i];
+			e.motion[i] = PATROL;
+		}
+		return false;
+	}
+	if (e.motion[i] == PATROL) {
+		e.wx[i] = e.vx[i];
+		e.wy[i] = e.vy[i];
+	}
+	// claim the nearest pellet no other fish claimed this step, else share the nearest
+	vec2 p = e.Position(i);
+	int target = pelletGrid.Nearest(p, true);
+	if (!target)
+		target = pelletGrid.Nearest(p);
+	if (!target) {
+		e.motion[i] = STILL;				// wait for a pellet
+		return false;
+	}
+	pelletGrid.Claim(target);
+	// straight line to it
+	vec2 d = e.Position(e.Index(target))-p;
+	float len = length(d);
+	e.vx[i] = len > 0? swimSpeed*d.x/len : 0;
+	e.vy[i] = len > 0? swimSpeed*d.y/len : 0;
+	e.motion[i] = SEEK;
+	return true;
+}
+
+void TankSimulation::Feed() {
+	// while feeding, fish (unless schooling) head for pellets; a fish eats a pellet it overlaps
+	Entities &e = entities;
+	vector<int> eaten;
+	pelletGrid.NewRound();
+	for (int i = 0; i < e.Size(); i++) {
+		if (e.kind[i] != KIND_FISH || (!schooling && !Aim(i)))
+			continue;
+		vec2 p = e.Position(i), reach = fishSize+pelletSize;
+		pelletGrid.QueryBox(p-reach, p+reach, near);
+		for (int id : near)
+			if (!eats || eats(*this, i, e.Index(id))) {
+				pelletGrid.Remove(id);			// so no other fish eats it
+				eaten.push_back(id);
+				money += .1;
+				nEaten++;
+				break;
+			}
+	}
+	for (int id : eaten)
+		Remove(id);
+}
+
+int TankSimulation::DropPellet(vec2 position) {
+	int id = entities.Create(KIND_PELLET, position);
+	pelletGrid.Insert(id, position);
+	return id;
+}
+
+bool TankSimulation::CleanMess(int id) {
+	int i = entities.Index(id);
+	if (i < 0 || entities.kind[i] != KIND_MESS)
+		return false;
+	Remove(id);
+	money += .5;
+	nMessesCleaned++;
+	return true;
+}
+
+void TankSimulation::ClearPellets() {
+	near.resize(0);
+	for (int i = 0; i < entities.Size(); i++)
+		if (entities.kind[i] == KIND_PELLET)
+			near.push_back(entities.id[i]);
+	for (int id : near)
+		Remove(id);
+}
+
+void TankSimulation::Remove(int id) {
+	if (itemRemoved)
+		itemRemoved(*this, id);
+	pelletGrid.Remove(id);
+	entities.Destroy(id);
+}
@@ -0,0 +1,62 @@
+// TankSimulation.h - fixed-timestep fish tank simulation, independent of display
+
+#ifndef TANK_SIMULATION_HDR
+#define TANK_SIMULATION_HDR
+
+#include <random>
+#include "Entities.h"
+#include "Flock.h"
+#include "PointGrid.h"
+#include "ThreadPool.h"
+#include "VecMat.h"
+
+// game logic advances in steps of dt simulated seconds, whatever the display rate;
+// speeds are per second, positions are NDC; no GL or GLFW calls, so the
+// simulation runs headless (eg, hours of tank economy in seconds)
+
+class TankSimulation {
+public:
+	TankSimulation(unsigned int seed = 1);
+		// the tank starts with one fish
+	static constexpr float dt = 1.f/60;	// seconds per step
+	float Advance(double seconds);
+		// take as many steps as fit in seconds (plus the remainder from the last call);
+		// return fraction of a step remaining, for render interpolation
+	void Step();
+	// state
+	double time = 0, money = 0;
+	int numFish = 1;
+	bool feeding = false;
+	bool schooling = false;		// fish flock (toward the oldest pellet if feeding) rather than bounce or beeline
+	Flock flock;
+	Entities entities;			// creatures, pellets, messes
+	int nEaten = 0, nMessesSpawned = 0, nMessesCleaned = 0;
+	vector<int> turns;			// indices of entities that turned during the last step
+	// player actions
+	int AddCreature(EntityKind k);
+		// KIND_FISH, KIND_SNAIL, KIND_REDFISH or KIND_GOLDFISH at its usual start; return id
+	int DropPellet(vec2 position);
+		// return id
+	bool CleanMess(int id);
+	void ClearPellets();
+	float Random(float min, float max);
+	// optional display hooks
+	void (*itemAdded)(TankSimulation &t, int id) = NULL;
+		// a mess was spawned
+	void (*itemRemoved)(TankSimulation &t, int id) = NULL;
+		// a pellet is about to be eaten or cleared, or a mess cleaned
+	bool (*eats)(TankSimulation &t, int fish, int pellet) = NULL;
+		// exact test of fish against a pellet (entity indices) whose box it overlaps; if NULL, box overlap suffices
+	vec2 fishSize = vec2(.3f, .3f), pelletSize = vec2(.025f, .025f);	// half-extents for the box test
+private:
+	double accumulator = 0, incomeTime = 0, messTime = 0;
+	std::mt19937 rng;
+	PointGrid pelletGrid;		// pellets by id, for nearest and overlap queries
+	vector<int> near;			// scratch, pellet ids
+	ThreadPool pool;
+	void Feed();
+	bool Aim(int i);
+	void Remove(int id);
+};
+
+#endif
@@ -4,6 +4,7 @@
 
 #include <glad.h>
 #include "Draw.h"
+#include "GLState.h"
 #include "GLXtras.h"
 #include "Text.h"
 #include <map>
@@ -58,14 +59,24 @@ int TextWidth(int scale, const char *format, ...) {
 	return (int) TextWidth((float) scale, text);
 }
 CharacterSet *SetFont(const char *fontName, int charRes, int pixelRes, bool forceInit) { return NULL; };
+void BeginText() { BeginLetters(); }
+void EndText() { EndLetters(); }
+void SetTextSDF(bool sdf) { SetLetterSDF(sdf); }
 #else
 
 #include <ft2build.h>
 #include <freetype/freetype.h>
+#include <algorithm>
+#include <iterator>
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include "DistanceField.h"
 
 using std::string;
+using std::vector;
 
-static GLuint textShaderProgram = 0, textVertexBuffer = 0;
+static GLuint textShaderProgram = 0;
 
 CharacterSet *currentFont = NULL;
 
@@ -74,8 +85,94 @@ struct Compare { bool operator() (const string &a, const string &b) const { retu
 typedef std::map<string, CharacterSet, Compare> CharacterSets;
 CharacterSets fonts;
 
-void SetCharacterSet(CharacterSet &cs, const char *fontName, int charRes, int pixelRes) {
-	cs.charRes = charRes;
+// Glyph atlas: all 128 glyphs of a font, shelf-packed into one GL_RED texture,
+// as coverage or (if SetTextSDF) as signed distance fields
+
+bool textSDF = false;
+const int sdfSpread = 6;	// pixels about each glyph's edge
+
+struct GlyphAtlas {
+	GLuint texture = 0;
+	int pad = 0;			// pixels of field about each glyph bitmap
+	string fontName;
+	int pixelRes = 0;
+	vec4 uv[128];			// u0, v0, u1, v1 (v0 is glyph top)
+	float advance[128] = {};	// pixels (FreeType advance is 1/64 pixel)
+};
+
+std::map<const CharacterSet *, GlyphAtlas> atlases;
+
+void ClearTextMeshes();
+
+namespace {
+
+// distance fields are slow enough to generate that they are cached on disk, beside
+// the font file, by font and resolution
+
+struct GlyphRecord { int w, h, left, top; GLuint advance; vec4 uv; };
+
+const int atlasWidth = 1024, maxAtlasHeight = 16384;
+
+string CachePath(const char *fontName, int charRes, int pixelRes) {
+	// eg, C:/Fonts/Arial.ttf to C:/Fonts/Arial-12-72.sdf
+	string name(fontName);
+	size_t slash = name.find_last_of("/\\"), dot = name.find_last_of('.');
+	if (dot != string::npos && (slash == string::npos || dot > slash+1))
+		name = name.substr(0, dot);
+	return name+"-"+std::to_string(charRes)+"-"+std::to_string(pixelRes)+".sdf";
+}
+
+bool ReadCache(const string &path, int charRes, int pixelRes, CharacterSet &cs, GlyphAtlas &a,
+			   vector<unsigned char> &pixels, int &w, int &h) {
+	// false unless the file was written for this resolution and spread, at a plausible size
+	FILE *in = fopen(path.c_str(), "rb");
+	if (!in)
+		return false;
+	char magic[4];
+	int spread, res[2];
+	GlyphRecord g[128];
+	bool ok = fread(magic, 4, 1, in) == 1 && !strncmp(magic, "SDF2", 4) &&
+			  fread(&spread, sizeof(int), 1, in) == 1 && spread == sdfSpread &&
+			  fread(res, sizeof(res), 1, in) == 1 && res[0] == charRes && res[1] == pixelRes &&
+			  fread(&w, sizeof(int), 1, in) == 1 && fread(&h, sizeof(int), 1, in) == 1 &&
+			  w == atlasWidth && h > 0 && h <= maxAtlasHeight &&
+			  fread(g, sizeof(g), 1, in) == 1;
+	if (ok) {
+		pixels.resize(w*h);
+		ok = fread(pixels.data(), 1, w*h, in) == (size_t) (w*h);
+	}
+	fclose(in);
+	if (ok)
+		for (int c = 0; c < 128; c++) {
+			cs.characters[c] = Character(0, int2(g[c].w, g[c].h), int2(g[c].left, g[c].top), g[c].advance);
+			a.uv[c] = g[c].uv;
+		}
+	return ok;
+}
+
+void WriteCache(const string &path, int charRes, int pixelRes, CharacterSet &cs, GlyphAtlas &a,
+				vector<unsigned char> &pixels, int w, int h) {
+	FILE *out = fopen(path.c_str(), "wb");
+	if (!out)
+		return;
+	GlyphRecord g[128];
+	for (int c = 0; c < 128; c++) {
+		Character &ch = cs.characters[c];
+		g[c] = { ch.gSize.i1, ch.gSize.i2, ch.bearing.i1, ch.bearing.i2, ch.advance, a.uv[c] };
+	}
+	int res[] = { charRes, pixelRes };
+	fwrite("SDF2", 4, 1, out);
+	fwrite(&sdfSpread, sizeof(int), 1, out);
+	fwrite(res, sizeof(res), 1, out);
+	fwrite(&w, sizeof(int), 1, out);
+	fwrite(&h, sizeof(int), 1, out);
+	fwrite(g, sizeof(g), 1, out);
+	fwrite(pixels.data(), 1, w*h, out);
+	fclose(out);
+}
+
+bool RasterizeGlyphs(CharacterSet &cs, GlyphAtlas &a, const char *fontName, int charRes, int pixelRes,
+					 vector<unsigned char> &pixels, int &atlasW, int &atlasH) {
 	// init FreeType, load font face
 	FT_Library ft;
 	FT_Face face;
@@ -84,47 +181,123 @@ void SetCharacterSet(CharacterSet &cs, const char *fontName, int charRes, int pi
 		FT_Set_Char_Size(face, 0, charRes*64, pixelRes, pixelRes) || // set character point size
 		FT_Set_Pixel_Sizes(face, 0, pixelRes))  {                    // set pixel res
 			printf("problem loading %s\n", fontName);
-			return;
+			return false;
 	}
-	// load glyphs
+	// render glyphs, place each on a shelf (row) of a fixed-width atlas
+	const int pad = 1;
+	struct Bitmap { vector<unsigned char> pixels; int x = 0, y = 0, w = 0, h = 0; } bitmaps[128];
+	int x = pad, y = pad, shelfH = 0;
+	atlasW = atlasWidth;
 	FT_GlyphSlot g = face->glyph;
 	for (GLubyte c = 0; c < 128; c++) {
 		FT_Error r = FT_Load_Char(face, c, FT_LOAD_RENDER);
-		if (r)
+		if (r) {
 			printf("FreeType: failed to load Glyph\n");
-		else {
-			// generate texture
-			GLuint texture;
-			glGenTextures(1, &texture);
-			glBindTexture(GL_TEXTURE_2D, texture);
-			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, g->bitmap.width, g->bitmap.rows, 0, GL_RED, GL_UNSIGNED_BYTE, g->bitmap.buffer);
-			// texture options
-			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			// store character
-			cs.characters[c] = Character(texture, int2(g->bitmap.width, g->bitmap.rows), int2(g->bitmap_left, g->bitmap_top), (GLuint) g->advance.x);
+			continue;
+		}
+		Bitmap &b = bitmaps[c];
+		int gw = g->bitmap.width, gh = g->bitmap.rows;
+		for (int j = 0; j < gh; j++)
+			b.pixels.insert(b.pixels.end(), g->bitmap.buffer+j*g->bitmap.pitch, g->bitmap.buffer+j*g->bitmap.pitch+gw);
+		b.w = gw;
+		b.h = gh;
+		if (a.pad && gw && gh) {
+			// field extends pad pixels beyond the bitmap
+			int pw = gw+2*a.pad, ph = gh+2*a.pad;
+			vector<unsigned char> padded(pw*ph, 0);
+			for (int j = 0; j < gh; j++)
+				std::copy(b.pixels.begin()+j*gw, b.pixels.begin()+(j+1)*gw, padded.begin()+(j+a.pad)*pw+a.pad);
+			DistanceField(padded.data(), pw, ph, sdfSpread, b.pixels);
+			b.w = pw;
+			b.h = ph;
 		}
+		if (x+b.w+pad > atlasW) {
+			x = pad;
+			y += shelfH+pad;
+			shelfH = 0;
+		}
+		b.x = x;
+		b.y = y;
+		x += b.w+pad;
+		shelfH = b.h > shelfH? b.h : shelfH;
+		cs.characters[c] = Character(0, int2(gw, gh), int2(g->bitmap_left, g->bitmap_top), (GLuint) g->advance.x);
 	}
 	FT_Done_Face(face);
 	FT_Done_FreeType(ft);
+	atlasH = y+shelfH+pad;
+	pixels.assign(atlasW*atlasH, 0);
+	for (int c = 0; c < 128; c++) {
+		Bitmap &b = bitmaps[c];
+		for (int j = 0; j < b.h; j++)
+			std::copy(b.pixels.begin()+j*b.w, b.pixels.begin()+(j+1)*b.w, pixels.begin()+(b.y+j)*atlasW+b.x);
+		a.uv[c] = vec4((float) b.x/atlasW, (float) b.y/atlasH, (float) (b.x+b.w)/atlasW, (float) (b.y+b.h)/atlasH);
+	}
+	return true;
+}
+
+} // end namespace
+
+void SetCharacterSet(CharacterSet &cs, const char *fontName, int charRes, int pixelRes) {
+	cs.charRes = charRes;
+	GlyphAtlas &a = atlases[&cs];
+	a.pad = textSDF? sdfSpread : 0;
+	a.fontName = fontName;
+	a.pixelRes = pixelRes;
+	vector<unsigned char> pixels;
+	int w = 0, h = 0;
+	string cache = textSDF? CachePath(fontName, charRes, pixelRes) : string();
+	if (!textSDF || !ReadCache(cache, charRes, pixelRes, cs, a, pixels, w, h)) {
+		if (!RasterizeGlyphs(cs, a, fontName, charRes, pixelRes, pixels, w, h))
+			return;
+		if (textSDF)
+			WriteCache(cache, charRes, pixelRes, cs, a, pixels, w, h);
+	}
+	// one texture for all glyphs
+	if (a.texture)
+		DeleteTextures(1, &a.texture);
+	glGenTextures(1, &a.texture);
+	BindTexture(GL_TEXTURE_2D, a.texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, w, h, 0, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+	for (int c = 0; c < 128; c++) {
+		Character &ch = cs.characters[c];
+		ch.textureID = a.texture;
+		a.advance[c] = (float) (ch.advance >> 6);
+	}
+	// texture options
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 }
 
 CharacterSet *SetFont(const char *fontName, int charRes, int pixelRes, bool forceInit) {
-	CharacterSets::iterator it = fonts.find(fontName);
+	// coverage and distance-field atlases of a font are distinct character sets
+	string key = string(fontName)+(textSDF? "#sdf" : "");
+	CharacterSets::iterator it = fonts.find(key);
 	if (it == fonts.end() || forceInit) {
-		CharacterSet cs;
+		if (it != fonts.end())
+			ClearTextMeshes();		// meshes of the old glyphs are stale
+		CharacterSet &cs = fonts[key];
+		cs = CharacterSet();
 		SetCharacterSet(cs, fontName, charRes, pixelRes);
-		fonts[string(fontName)] = cs;
-		it = fonts.find(fontName);
+		it = fonts.find(key);
 	}
 	currentFont = &it->second;
 	return currentFont;
 }
 
+void SetTextSDF(bool sdf) {
+	if (sdf == textSDF)
+		return;
+	textSDF = sdf;
+	if (currentFont) {
+		// current font, in new mode
+		GlyphAtlas a = atlases[currentFont];
+		SetFont(a.fontName.c_str(), currentFont->charRes, a.pixelRes);
+	}
+}
+
 CharacterSet *GetFont() {
 	return currentFont;
 }
@@ -135,8 +308,9 @@ const char *textVertexShader = R"(
 	in vec4 point;
 	out vec2 vUv;
 	uniform mat4 view;
+	uniform vec2 offset;
 	void main() {
-		gl_Position = view*vec4(point.xy, 0, 1);
+		gl_Position = view*vec4(point.xy+offset, 0, 1);
 		vUv = point.zw;
 	}
 )";
@@ -146,8 +320,9 @@ const char *textVertexShader = R"(
 	in vec4 point;
 	out vec2 vUv;
 	uniform mat4 view;
+	uniform vec2 offset;
 	void main() {
-		gl_Position = view*vec4(point.xy, 0, 1);
+		gl_Position = view*vec4(point.xy+offset, 0, 1);
 		vUv = point.zw;
 	}
 )";
@@ -160,8 +335,14 @@ const char *textPixelShader = R"(
 	out vec4 pColor;
 	uniform sampler2D textureImage;
 	uniform vec3 color;
+	uniform bool sdf = false;
 	void main() {
 		float a = texture(textureImage, vUv).r;
+		if (sdf) {
+			// edge at .5, antialiased over a pixel whatever the magnification
+			float w = fwidth(a);
+			a = smoothstep(.5-w, .5+w, a);
+		}
 		pColor = vec4(color, a);
 	}
 )";
@@ -172,8 +353,14 @@ const char *textPixelShader = R"(
 	out vec4 pColor;
 	uniform sampler2D textureImage;
 	uniform vec3 color;
+	uniform bool sdf = false;
 	void main() {
 		float a = texture(textureImage, vUv).r;
+		if (sdf) {
+			// edge at .5, antialiased over a pixel whatever the magnification
+			float w = fwidth(a);
+			a = smoothstep(.5-w, .5+w, a);
+		}
 		pColor = vec4(color, a);
 	}
 )";
@@ -185,51 +372,123 @@ GLuint GetTextShaderProgram() {
 	return textShaderProgram;
 };
 
+// Text meshes: laid-out strings (quads relative to the string origin), cached
+// least-recently-used by (font, scale, vertical, text); a string drawn again,
+// wherever placed, reuses its vertex buffer
+
+namespace {
+
+struct TextMesh {
+	string key;
+	GLuint vao = 0, vbo = 0;
+	int nVertices = 0;
+	vec2 end;				// pen position after last glyph, wrt origin
+};
+
+const size_t maxTextMeshes = 128;
+std::list<TextMesh> meshes;	// most recently used first
+std::unordered_map<string, std::list<TextMesh>::iterator> meshIndex;
+
+string MeshKey(const CharacterSet *font, float scale, bool vertical, const char *text) {
+	string key((const char *) &font, sizeof(font));
+	key.append((const char *) &scale, sizeof(scale));
+	key += vertical? 'v' : 'h';
+	return key+text;
+}
+
+void BuildMesh(TextMesh &m, const char *text, float scale, bool vertical) {
+	GlyphAtlas &a = atlases[currentFont];
+	vector<vec4> vertices;
+	float x = 0, y = 0;
+	for (const char *c = text; *c; c++) {
+		int i = *c & 127;
+		Character &ch = currentFont->characters[i];
+		float w = ch.gSize.i1*scale, h = ch.gSize.i2*scale, pad = w > 0 && h > 0? a.pad*scale : 0;
+		float x0 = x+ch.bearing.i1*scale-pad, y0 = y-(ch.gSize.i2-ch.bearing.i2)*scale-pad;
+		float x1 = x0+w+2*pad, y1 = y0+h+2*pad;
+		vec4 uv = a.uv[i];
+		// two triangles, glyph top at v0
+		vec4 q[] = { vec4(x0, y1, uv.x, uv.y), vec4(x1, y1, uv.z, uv.y), vec4(x1, y0, uv.z, uv.w), vec4(x0, y0, uv.x, uv.w) };
+		int tris[] = { 0, 1, 2, 0, 2, 3 };
+		if (w > 0 && h > 0)
+			for (int t : tris)
+				vertices.push_back(q[t]);
+		if (vertical)
+			y -= 24*scale;
+		else
+			x += a.advance[i]*scale;
+	}
+	if (!m.vao) {
+		glGenVertexArrays(1, &m.vao);
+		glGenBuffers(1, &m.vbo);
+	}
+	BindVertexArray(m.vao);
+	glBindBuffer(GL_ARRAY_BUFFER, m.vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(vec4), vertices.data(), GL_STATIC_DRAW);
+	VertexAttribPointer(textShaderProgram, "point", 4, sizeof(vec4), 0);
+	m.nVertices = (int) vertices.size();
+	m.end = vec2(x, y);
+}
+
+TextMesh &GetMesh(const char *text, float scale, bool vertical) {
+	string key = MeshKey(currentFont, scale, vertical, text);
+	auto found = meshIndex.find(key);
+	if (found != meshIndex.end()) {
+		meshes.splice(meshes.begin(), meshes, found->second);
+		return meshes.front();
+	}
+	if (meshes.size() < maxTextMeshes)
+		meshes.emplace_front();
+	else {
+		// recycle least recently used buffers
+		meshes.splice(meshes.begin(), meshes, std::prev(meshes.end()));
+		meshIndex.erase(meshes.front().key);
+	}
+	TextMesh &m = meshes.front();
+	m.key = key;
+	meshIndex[key] = meshes.begin();
+	BuildMesh(m, text, scale, vertical);
+	return m;
+}
+
+} // end namespace
+
+void ClearTextMeshes() {
+	for (TextMesh &m : meshes) {
+		glDeleteBuffers(1, &m.vbo);
+		DeleteVertexArrays(1, &m.vao);
+	}
+	meshes.clear();
+	meshIndex.clear();
+}
+
 vec2 RenderText(const char *text, float x, float y, vec3 color, float scale, mat4 view, bool vertical) {
 	if (!currentFont)
 		SetFont("C:/Fonts/OpenSans/OpenSans-Regular.ttf", 64, 100);  // unsure exact effect of charRes, pixelRes
 	if (!textShaderProgram)
 		textShaderProgram = LinkProgramViaCode(&textVertexShader, &textPixelShader);
-	glUseProgram(textShaderProgram);
+	UseProgram(textShaderProgram);
 	scale /= (float) currentFont->charRes;
-	// create quad vertex buffer and build characters
-	if (textVertexBuffer == 0)
-		glGenBuffers(1, &textVertexBuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, textVertexBuffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(float)*6*4, NULL, GL_DYNAMIC_DRAW);
-	VertexAttribPointer(textShaderProgram, "point", 4, 4*sizeof(float), 0);
+	TextMesh &m = GetMesh(text, scale, vertical);
 	SetUniform(textShaderProgram, "view", view);
+	SetUniform(textShaderProgram, "offset", vec2(x, y));
 	SetUniform(textShaderProgram, "color", color);
-	// SetUniform(textShaderProgram, "textureImage", (int) textureID); // not needed? (defaults to 0?)
-	glActiveTexture(GL_TEXTURE0);
-	glBindBuffer(GL_ARRAY_BUFFER, textVertexBuffer);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	for (const char *c = text; *c; c++) {
-		Character ch = currentFont->characters[(int)*c];
-		float w = ch.gSize.i1*scale, h = ch.gSize.i2*scale;
-		float xpos = x+ch.bearing.i1*scale, ypos = y-(ch.gSize.i2-ch.bearing.i2)*scale;
-		glBindTexture(GL_TEXTURE_2D, ch.textureID);
-		// update vertex memory
-#ifndef __APPLE__
-		float vertices[][4] = {{xpos, ypos+h, 0, 0}, {xpos+w, ypos+h, 1, 0}, {xpos+w, ypos, 1, 1}, {xpos, ypos, 0, 1}};
-		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-		glDrawArrays(GL_QUADS, 0, 4);     // render glyph texture with quad
-#else
-		float vertices[][4] = {{xpos, ypos+h, 0, 0}, {xpos+w, ypos+h, 1, 0}, {xpos+w, ypos, 1, 1},
-							   {xpos, ypos+h, 0, 0}, {xpos+w, ypos, 1, 1},   {xpos, ypos, 0, 1}};
-		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-		glDrawArrays(GL_TRIANGLES, 0, 6); // render glyph texture with triangles
-#endif
-		if (vertical)
-			y -= 24*scale;
-		else
-			x += (ch.advance >> 6)*scale;     // advance character position in terms of 1/64 pixel
-	}
-	glBindVertexArray(0);
-	return vec2(x, y);
+	SetUniform(textShaderProgram, "textureImage", 0);
+	SetUniform(textShaderProgram, "sdf", atlases[currentFont].pad > 0);
+	ActiveTexture(GL_TEXTURE0);
+	BindTexture(GL_TEXTURE_2D, atlases[currentFont].texture);
+	Enable(GL_BLEND);
+	BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	BindVertexArray(m.vao);
+	glDrawArrays(GL_TRIANGLES, 0, m.nVertices);	// whole string
+	BindVertexArray(0);
+	return vec2(x, y)+m.end;
 }
 
+// no deferral needed for FreeType text: each string is one (cached) draw
+void BeginText() { }
+void EndText() { }
+
 float TextWidth(float scale, const char *format, ...) {
 	float w = 0;
 	char text[500];
@@ -239,10 +498,9 @@ float TextWidth(float scale, const char *format, ...) {
 			// name, charRes, pixelRes
 	if (currentFont != NULL) {
 		scale /= (float) currentFont->charRes;
-		for (const char* c = text; *c; c++) {
-			Character ch = currentFont->characters[(int)*c];
-			w += (ch.advance >> 6) * scale;
-		}
+		const float *advance = atlases[currentFont].advance;
+		for (const char* c = text; *c; c++)
+			w += advance[*c & 127]*scale;
 	}
 	return w;
 }
@@ -0,0 +1,332 @@
+// TextureCache.cpp - share GPU textures among sprites that read the same image file
+
+#include <glad.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include "AlphaMask.h"
+#include "AssetLoader.h"
+#include "Atlas.h"
+#include "GLState.h"
+#include "IO.h"
+#include "STB_Image.h"
+#include "TextureCache.h"
+#include "TexturePack.h"
+
+using std::string;
+
+namespace {
+
+struct CachedImage {
+	vector<GLuint> textureNames;	// one per frame
+	vector<float> frameDurations;
+	GLuint backing = 0;				// if names are reserved: texture array, or asynchronously loaded texture
+	int loadId = 0;					// while loading asynchronously
+	int nChannels = 0, width = 0, height = 0;
+	int nLive = 0;					// frames with non-zero references
+};
+
+struct TextureRef {
+	string key;
+	int refs = 0;
+};
+
+std::unordered_map<string, CachedImage> images;	// by key
+std::unordered_map<GLuint, TextureRef> refs;		// by texture name
+bool async = false;
+GLuint placeholder = 0;
+
+string Key(const char *filename, bool mipmap) { return string(filename)+(mipmap? "" : "#nomip"); }
+
+void AddRefs(const string &key, CachedImage &c) {
+	for (GLuint t : c.textureNames) {
+		TextureRef &r = refs[t];
+		if (r.refs++ == 0) {
+			r.key = key;
+			c.nLive++;
+		}
+	}
+}
+
+GLuint MakeTextureArray(unsigned char *pixels, int width, int height, int nFrames, int nChannels) {
+	// as LoadTexture, for frames stored consecutively
+	GLenum format = nChannels == 4? GL_RGBA : nChannels == 3? GL_RGB : nChannels == 2? GL_RG : GL_RED;
+	GLuint array = 0;
+	glGenTextures(1, &array);
+	BindTexture(GL_TEXTURE_2D_ARRAY, array);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, format, width, height, nFrames, 0, format, GL_UNSIGNED_BYTE, pixels);
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	BindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	return array;
+}
+
+void NameLayers(CachedImage &c, unsigned char *pixels, int nFrames) {
+	// make the array, and a texture name (with hit-test mask) for each of its layers
+	c.backing = MakeTextureArray(pixels, c.width, c.height, nFrames, c.nChannels);
+	size_t frameSize = (size_t) c.width*c.height*c.nChannels;
+	for (int f = 0; f < nFrames; f++) {
+		TextureBinding b;
+		b.texture = c.backing;
+		b.target = GL_TEXTURE_2D_ARRAY;
+		b.layer = f;
+		GLuint name = ReserveTextureName(b);
+		BuildAlphaMask(name, pixels+f*frameSize, c.width, c.height, c.nChannels);
+		c.textureNames.push_back(name);
+	}
+}
+
+// Texture Packs
+
+bool Packed(CachedImage &c, const char *filename, bool mipmap) {
+	// no decode: levels and mask come from the open pack
+	PackedImage im;
+	if (!FindPackedImage(filename, im))
+		return false;
+	c.width = im.width; c.height = im.height; c.nChannels = im.nChannels;
+	GLuint textureName = LoadPackedTexture(im, mipmap);
+	SetAlphaMask(textureName, im.mask);
+	c.textureNames.push_back(textureName);
+	return true;
+}
+
+bool PackedArray(CachedImage &c, vector<string> &filenames) {
+	vector<PackedImage> frames(filenames.size());
+	for (size_t f = 0; f < filenames.size(); f++) {
+		PackedImage &im = frames[f];
+		if (!FindPackedImage(filenames[f].c_str(), im))
+			return false;
+		if (f && (im.width != frames[0].width || im.height != frames[0].height || im.nStored != frames[0].nStored ||
+				  im.format != frames[0].format || im.nLevels != frames[0].nLevels))
+			return false;					// layers must share size, levels and storage (eg, BC1 and BC7 can't mix)
+	}
+	c.width = frames[0].width; c.height = frames[0].height; c.nChannels = frames[0].nChannels;
+	c.backing = LoadPackedTextureArray(frames);
+	for (int f = 0; f < (int) frames.size(); f++) {
+		TextureBinding b;
+		b.texture = c.backing;
+		b.target = GL_TEXTURE_2D_ARRAY;
+		b.layer = f;
+		GLuint name = ReserveTextureName(b);
+		SetAlphaMask(name, frames[f].mask);
+		c.textureNames.push_back(name);
+	}
+	return true;
+}
+
+// Asynchronous Loading
+
+GLuint Placeholder() {
+	// faint, translucent grey
+	if (!placeholder) {
+		unsigned char pixel[] = { 200, 200, 200, 48 };
+		placeholder = LoadTexture(pixel, 1, 1, 4, false, false);
+	}
+	return placeholder;
+}
+
+void Loaded(const string &key, LoadedAsset &a) {
+	// rebind the names reserved by LoadAsync to the new texture (or its layers)
+	auto i = images.find(key);
+	if (i == images.end())
+		return;
+	CachedImage &c = i->second;
+	c.loadId = 0;
+	if (!a.texture)
+		return;								// unreadable after all; placeholder remains
+	c.backing = a.texture;
+	size_t frameSize = (size_t) c.width*c.height*c.nChannels;
+	for (int f = 0; f < (int) c.textureNames.size(); f++) {
+		TextureBinding b;
+		b.texture = a.texture;
+		b.target = a.target;
+		b.layer = a.target == GL_TEXTURE_2D_ARRAY? f : -1;
+		RebindTextureName(c.textureNames[f], b);
+		BuildAlphaMask(c.textureNames[f], a.pixels+f*frameSize, c.width, c.height, c.nChannels);
+	}
+}
+
+bool SameFrames(CachedImage &c, vector<string> &filenames) {
+	// from the headers, set c's size and #channels; false if unreadable or frames differ
+	for (string &f : filenames) {
+		int w, h, n;
+		if (!stbi_info(f.c_str(), &w, &h, &n)) {
+			printf("CacheTexture: can't open %s (%s)\n", f.c_str(), stbi_failure_reason());
+			return false;
+		}
+		if (&f != &filenames[0] && (w != c.width || h != c.height || n != c.nChannels))
+			return false;
+		c.width = w; c.height = h; c.nChannels = n;
+	}
+	return true;
+}
+
+bool LoadAsync(const string &key, vector<string> &filenames, bool array, bool mipmap) {
+	// header now (so callers learn size and #channels), pixels later
+	CachedImage c;
+	if (!SameFrames(c, filenames))
+		return false;
+	TextureBinding b;
+	b.texture = Placeholder();
+	for (int f = 0; f < (array? (int) filenames.size() : 1); f++)
+		c.textureNames.push_back(ReserveTextureName(b));
+	c.loadId = RequestAsset(filenames, array, mipmap, [key](LoadedAsset &a) { Loaded(key, a); });
+	images.emplace(key, c);
+	return true;
+}
+
+} // end namespace
+
+GLuint CacheTexture(const char *filename, bool mipmap, int *nChannels, int *width, int *height) {
+	string key = Key(filename, mipmap);
+	auto i = images.find(key);
+	if (i == images.end()) {
+		CachedImage c;
+		if (Packed(c, filename, mipmap))
+			i = images.emplace(key, c).first;
+	}
+	if (i == images.end() && async) {
+		vector<string> filenames(1, filename);
+		if (!LoadAsync(key, filenames, false, mipmap))
+			return 0;
+		i = images.find(key);
+	}
+	if (i == images.end()) {
+		// as ReadTexture, but keep the pixels long enough to build the hit-test mask
+		CachedImage c;
+		stbi_set_flip_vertically_on_load(true);
+		unsigned char *data = stbi_load(filename, &c.width, &c.height, &c.nChannels, 0);
+		if (!data) {
+			printf("CacheTexture: can't open %s (%s)\n", filename, stbi_failure_reason());
+			return 0;
+		}
+		GLuint textureName = LoadTexture(data, c.width, c.height, c.nChannels, false, mipmap);
+		BuildAlphaMask(textureName, data, c.width, c.height, c.nChannels);
+		stbi_image_free(data);
+		c.textureNames.push_back(textureName);
+		i = images.emplace(key, c).first;
+	}
+	CachedImage &c = i->second;
+	AddRefs(key, c);
+	if (nChannels) *nChannels = c.nChannels;
+	if (width) *width = c.width;
+	if (height) *height = c.height;
+	return c.textureNames[0];
+}
+
+int CacheGIF(const char *filename, vector<GLuint> &textureNames, int *nChannels, vector<float> *frameDurations) {
+	string key = Key(filename, true);
+	auto i = images.find(key);
+	if (i == images.end()) {
+		// as ReadGIF, but frames become layers of one array texture
+		CachedImage c;
+		int nFrames = 0;
+		unsigned char *pixels = DecodeGIF(filename, c.width, c.height, nFrames, c.nChannels, &c.frameDurations);
+		if (!pixels)
+			return 0;
+		NameLayers(c, pixels, nFrames);
+		stbi_image_free(pixels);
+		i = images.emplace(key, c).first;
+	}
+	CachedImage &c = i->second;
+	AddRefs(key, c);
+	textureNames = c.textureNames;
+	if (nChannels) *nChannels = c.nChannels;
+	if (frameDurations) *frameDurations = c.frameDurations;
+	return (int) c.textureNames.size();
+}
+
+int CacheTextureArray(vector<string> &filenames, vector<GLuint> &textureNames, int *nChannels) {
+	string key = "#array";
+	for (string &f : filenames) {
+		if (images.find(Key(f.c_str(), true)) != images.end())
+			return 0;						// frame already has a texture (eg, in an atlas)
+		key += "|"+f;
+	}
+	auto i = images.find(key);
+	if (i == images.end()) {
+		CachedImage c;
+		if (PackedArray(c, filenames))
+			i = images.emplace(key, c).first;
+	}
+	if (i == images.end() && async) {
+		if (!LoadAsync(key, filenames, true, true))
+			return 0;
+		i = images.find(key);
+	}
+	if (i == images.end()) {
+		// headers first: frames that differ in size or #channels are not decoded twice
+		CachedImage c;
+		if (!SameFrames(c, filenames))
+			return 0;
+		size_t frameSize = (size_t) c.width*c.height*c.nChannels;
+		vector<unsigned char> pixels(frameSize*filenames.size());
+		stbi_set_flip_vertically_on_load(true);
+		for (size_t f = 0; f < filenames.size(); f++) {
+			int w, h, n;
+			unsigned char *data = stbi_load(filenames[f].c_str(), &w, &h, &n, 0);
+			bool same = data && w == c.width && h == c.height && n == c.nChannels;
+			if (same)
+				memcpy(pixels.data()+f*frameSize, data, frameSize);
+			stbi_image_free(data);
+			if (!same)
+				return 0;					// unreadable, or changed since its header was read
+		}
+		NameLayers(c, pixels.data(), (int) filenames.size());
+		i = images.emplace(key, c).first;
+	}
+	CachedImage &c = i->second;
+	AddRefs(key, c);
+	textureNames = c.textureNames;
+	if (nChannels) *nChannels = c.nChannels;
+	return (int) c.textureNames.size();
+}
+
+void CacheTextureName(const char *filename, GLuint textureName, int nChannels, int width, int height) {
+	string key = Key(filename, true);
+	if (images.find(key) != images.end())
+		return;								// already read on its own
+	CachedImage c;
+	c.textureNames.push_back(textureName);
+	c.nChannels = nChannels;
+	c.width = width;
+	c.height = height;
+	AddRefs(key, images.emplace(key, c).first->second);
+}
+
+bool ReleaseTexture(GLuint textureName) {
+	auto r = refs.find(textureName);
+	if (r == refs.end())
+		return false;
+	if (--r->second.refs > 0)
+		return true;
+	string key = r->second.key;
+	refs.erase(r);
+	DeleteTextures(1, &textureName);
+	ReleaseAlphaMask(textureName);
+	ForgetTextureName(textureName);
+	auto i = images.find(key);
+	if (i != images.end() && --i->second.nLive == 0) {
+		if (i->second.loadId)
+			CancelAsset(i->second.loadId);
+		if (i->second.backing)
+			DeleteTextures(1, &i->second.backing);
+		images.erase(i);
+	}
+	return true;
+}
+
+void SetAsyncTextures(bool a) { async = a; }
+
+bool TextureReady(GLuint textureName) {
+	auto r = refs.find(textureName);
+	if (r == refs.end())
+		return true;
+	auto i = images.find(r->second.key);
+	return i == images.end() || !i->second.loadId;
+}
+
+int NCachedTextures() { return (int) refs.size(); }
@@ -0,0 +1,44 @@
+// TextureCache.h - share GPU textures among sprites that read the same image file
+
+#ifndef TEXTURE_CACHE_HDR
+#define TEXTURE_CACHE_HDR
+
+#include <glad.h>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+// textures are keyed by filename (and mipmap); each Cache call adds a reference,
+// each ReleaseTexture removes one, and the texture is deleted with the last reference
+
+GLuint CacheTexture(const char *filename, bool mipmap = true, int *nChannels = NULL, int *width = NULL, int *height = NULL);
+	// return texture for filename, reading it on first use; return 0 if unreadable
+
+int CacheGIF(const char *filename, vector<GLuint> &textureNames, int *nChannels = NULL, vector<float> *frameDurations = NULL);
+	// as CacheTexture, but frames are layers of one texture array, each with a texture
+	// name that resolves (ResolveTexture) to the array and layer; return # frames
+
+int CacheTextureArray(vector<string> &filenames, vector<GLuint> &textureNames, int *nChannels = NULL);
+	// as CacheGIF, for frames in separate files; return 0 (caching nothing) if the
+	// frames differ in size or #channels, or any is already cached (eg, in an atlas)
+
+void CacheTextureName(const char *filename, GLuint textureName, int nChannels, int width, int height);
+	// register a texture made elsewhere (eg, an atlas region) for filename; the cache
+	// holds one reference, released by the maker
+
+bool ReleaseTexture(GLuint textureName);
+	// return false if textureName not from the cache (texture is not deleted)
+
+void SetAsyncTextures(bool async);
+	// while set, CacheTexture and CacheTextureArray read only image headers and return
+	// at once; their names show a placeholder until the image is decoded on a worker
+	// thread and uploaded by UpdateAssets (see AssetLoader.h); GIFs still load at once
+
+bool TextureReady(GLuint textureName);
+	// false while textureName shows the placeholder
+
+int NCachedTextures();
+
+#endif
@@ -0,0 +1,392 @@
+// TexturePack.cpp - pre-decoded images, with mip chains and hit-test masks, in one mapped file
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unordered_map>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "BlockCompress.h"
+#include "GLState.h"
+#include "STB_Image.h"
+#include "TexturePack.h"
+
+namespace {
+
+// file layout: header, entries, then each entry's name, mask bits and levels;
+// offsets are from the start of the file, data 4-byte aligned
+
+const char magic[4] = { 'T', 'P', 'A', 'K' };
+const uint32_t version = 2;
+
+struct Header {
+	char magic[4];
+	uint32_t version, nEntries, pad;
+};
+
+struct Entry {
+	uint64_t nameOffset, maskOffset, pixelsOffset;
+	uint32_t nameLength, width, height, nChannels, nStored, nLevels, maskWidth, maskHeight;
+	uint32_t format, pad;				// 0 if raw, else block-compressed (BC1, BC3, BC7)
+	int64_t sourceSize, sourceTime;		// of the image file when packed
+};
+
+// the open pack
+const unsigned char *mapping = NULL;
+size_t mappingSize = 0;
+#ifdef _WIN32
+HANDLE file = INVALID_HANDLE_VALUE, fileMapping = NULL;
+#endif
+std::unordered_map<string, const Entry *> entries;	// by filename
+
+bool SourceStat(const char *filename, int64_t &size, int64_t &time) {
+	struct stat s;
+	if (stat(filename, &s) != 0)
+		return false;
+	size = (int64_t) s.st_size;
+	time = (int64_t) s.st_mtime;
+	return true;
+}
+
+int LevelSize(int size, int level) { return size >> level > 0? size >> level : 1; }
+
+int NLevels(int width, int height) {
+	int n = 1;
+	while (width >> n || height >> n)
+		n++;
+	return n;
+}
+
+void Downsample(const unsigned char *src, int w, int h, int n, unsigned char *dst) {
+	// box filter, as glGenerateMipmap; an odd last row or column is clamped
+	int dw = LevelSize(w, 1), dh = LevelSize(h, 1);
+	for (int j = 0; j < dh; j++) {
+		int j0 = 2*j < h? 2*j : h-1, j1 = 2*j+1 < h? 2*j+1 : h-1;
+		for (int i = 0; i < dw; i++) {
+			int i0 = 2*i < w? 2*i : w-1, i1 = 2*i+1 < w? 2*i+1 : w-1;
+			for (int k = 0; k < n; k++) {
+				int sum = src[(j0*w+i0)*n+k]+src[(j0*w+i1)*n+k]+src[(j1*w+i0)*n+k]+src[(j1*w+i1)*n+k];
+				dst[(j*dw+i)*n+k] = (unsigned char) ((sum+2)/4);
+			}
+		}
+	}
+}
+
+size_t LevelBytes(int width, int height, int nStored, GLenum format, int level) {
+	int w = LevelSize(width, level), h = LevelSize(height, level);
+	return format? CompressedSize(format, w, h) : (size_t) w*h*nStored;
+}
+
+size_t Align(size_t offset) { return (offset+3) & ~(size_t) 3; }
+
+bool InMapping(uint64_t offset, uint64_t length) { return offset <= mappingSize && length <= mappingSize-offset; }
+
+bool ValidEntry(const Entry &e) {
+	// every range within the mapping, sizes plausible (so level sizes can't overflow)
+	const uint32_t maxSide = 1 << 16;
+	if (!e.width || !e.height || e.width > maxSide || e.height > maxSide ||
+		(e.nStored != 1 && e.nStored != 4) || e.nLevels < 1 || e.nLevels > (uint32_t) NLevels(e.width, e.height) ||
+		(e.format && (e.nStored != 4 || (e.format != BC1 && e.format != BC3 && e.format != BC7))) ||
+		e.maskWidth > maxSide || e.maskHeight > maxSide || e.maskOffset%4)
+		return false;
+	uint64_t pixelBytes = 0;
+	for (int l = 0; l < (int) e.nLevels; l++)
+		pixelBytes += LevelBytes(e.width, e.height, e.nStored, e.format, l);
+	uint64_t maskBytes = ((uint64_t) e.maskWidth*e.maskHeight+31)/32*sizeof(unsigned int);
+	return InMapping(e.nameOffset, e.nameLength) && InMapping(e.maskOffset, maskBytes) && InMapping(e.pixelsOffset, pixelBytes);
+}
+
+bool Current(const Entry &e, const char *filename) {
+	// a missing file is not stale: the pack may ship alone
+	int64_t size, time;
+	return !SourceStat(filename, size, time) || (size == e.sourceSize && time == e.sourceTime);
+}
+
+void Unmap() {
+#ifdef _WIN32
+	if (mapping)
+		UnmapViewOfFile(mapping);
+	if (fileMapping)
+		CloseHandle(fileMapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+	fileMapping = NULL;
+	file = INVALID_HANDLE_VALUE;
+#else
+	if (mapping)
+		munmap((void *) mapping, mappingSize);
+#endif
+	mapping = NULL;
+	mappingSize = 0;
+}
+
+bool Map(const char *packFile) {
+#ifdef _WIN32
+	file = CreateFileA(packFile, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	GetFileSizeEx(file, &size);
+	mappingSize = (size_t) size.QuadPart;
+	fileMapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (fileMapping)
+		mapping = (const unsigned char *) MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	int fd = open(packFile, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat s;
+	if (fstat(fd, &s) == 0 && s.st_size > 0) {
+		void *m = mmap(NULL, (size_t) s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (m != MAP_FAILED) {
+			mapping = (const unsigned char *) m;
+			mappingSize = (size_t) s.st_size;
+		}
+	}
+	close(fd);							// the mapping remains
+#endif
+	if (!mapping)
+		Unmap();
+	return mapping != NULL;
+}
+
+} // end namespace
+
+bool WriteTexturePack(const char *packFile, vector<string> &imageFiles, int compressAbove) {
+	struct Image { string name; Entry e; vector<unsigned char> pixels; vector<unsigned int> mask; };
+	vector<Image> images;
+	stbi_set_flip_vertically_on_load(true);
+	for (string &f : imageFiles) {
+		Image im;
+		int w, h, n;
+		unsigned char *data = stbi_load(f.c_str(), &w, &h, &n, 0);
+		if (!data) {
+			printf("WriteTexturePack: can't open %s (%s)\n", f.c_str(), stbi_failure_reason());
+			continue;
+		}
+		memset(&im.e, 0, sizeof(Entry));
+		im.name = f;
+		SourceStat(f.c_str(), im.e.sourceSize, im.e.sourceTime);
+		int nStored = n == 1? 1 : 4;
+		im.e.width = w; im.e.height = h; im.e.nChannels = n; im.e.nStored = nStored;
+		im.e.nLevels = NLevels(w, h);
+		AlphaMask m;
+		m.Build(data, w, h, n);
+		im.e.maskWidth = m.width;
+		im.e.maskHeight = m.height;
+		im.mask = m.bits;
+		// level 0 as RGBA (or R), then the mip chain
+		size_t total = 0;
+		for (int l = 0; l < (int) im.e.nLevels; l++)
+			total += (size_t) LevelSize(w, l)*LevelSize(h, l)*nStored;
+		im.pixels.resize(total);
+		unsigned char *p = im.pixels.data();
+		for (int k = 0; k < w*h; k++, p += nStored) {
+			const unsigned char *d = data+k*n;
+			if (n == 1)
+				p[0] = d[0];
+			if (n == 2)
+				p[0] = p[1] = p[2] = d[0], p[3] = d[1];		// grey, alpha
+			if (n >= 3)
+				p[0] = d[0], p[1] = d[1], p[2] = d[2], p[3] = n == 4? d[3] : 255;
+		}
+		p = im.pixels.data();
+		stbi_image_free(data);
+		for (int l = 1; l < (int) im.e.nLevels; l++) {
+			unsigned char *next = p+(size_t) LevelSize(w, l-1)*LevelSize(h, l-1)*nStored;
+			Downsample(p, LevelSize(w, l-1), LevelSize(h, l-1), nStored, next);
+			p = next;
+		}
+		GLenum format = compressAbove && nStored == 4 && (w > compressAbove || h > compressAbove)?
+						ChooseBlockFormat(im.pixels.data(), w, h) : 0;
+		if (format) {
+			// replace each level with its blocks
+			vector<unsigned char> blocks;
+			const unsigned char *level = im.pixels.data();
+			for (int l = 0; l < (int) im.e.nLevels; l++) {
+				size_t at = blocks.size();
+				blocks.resize(at+LevelBytes(w, h, 4, format, l));
+				CompressImage(format, level, LevelSize(w, l), LevelSize(h, l), blocks.data()+at);
+				level += LevelBytes(w, h, 4, 0, l);
+			}
+			im.pixels.swap(blocks);
+			im.e.format = format;
+		}
+		images.push_back(im);
+	}
+	// assign offsets
+	Header header;
+	memcpy(header.magic, magic, 4);
+	header.version = version;
+	header.nEntries = (uint32_t) images.size();
+	header.pad = 0;
+	size_t offset = sizeof(Header)+images.size()*sizeof(Entry);
+	for (Image &im : images) {
+		im.e.nameOffset = offset;
+		im.e.nameLength = (uint32_t) im.name.size();
+		offset = Align(offset+im.name.size());
+		im.e.maskOffset = offset;
+		offset = Align(offset+im.mask.size()*sizeof(unsigned int));
+		im.e.pixelsOffset = offset;
+		offset = Align(offset+im.pixels.size());
+	}
+	// to a temporary file, renamed over packFile only once complete
+	CloseTexturePack();					// packFile may be the open pack
+	string temp = string(packFile)+".tmp";
+	FILE *out = fopen(temp.c_str(), "wb");
+	if (!out) {
+		printf("WriteTexturePack: can't write %s\n", temp.c_str());
+		return false;
+	}
+	const char zeros[4] = { 0, 0, 0, 0 };
+	auto Pad = [&]() { long at = ftell(out); fwrite(zeros, 1, Align(at)-at, out); };
+	fwrite(&header, sizeof(Header), 1, out);
+	for (Image &im : images)
+		fwrite(&im.e, sizeof(Entry), 1, out);
+	for (Image &im : images) {
+		fwrite(im.name.data(), 1, im.name.size(), out);
+		Pad();
+		fwrite(im.mask.data(), sizeof(unsigned int), im.mask.size(), out);
+		Pad();
+		fwrite(im.pixels.data(), 1, im.pixels.size(), out);
+		Pad();
+	}
+	bool ok = !ferror(out) && ftell(out) == (long) offset;
+	ok = fclose(out) == 0 && ok;
+#ifdef _WIN32
+	ok = ok && MoveFileExA(temp.c_str(), packFile, MOVEFILE_REPLACE_EXISTING);
+#else
+	ok = ok && rename(temp.c_str(), packFile) == 0;
+#endif
+	if (!ok) {
+		printf("WriteTexturePack: can't write %s\n", packFile);
+		remove(temp.c_str());
+	}
+	return ok;
+}
+
+bool OpenTexturePack(const char *packFile) {
+	CloseTexturePack();
+	if (!Map(packFile))
+		return false;
+	const Header *h = (const Header *) mapping;
+	if (mappingSize < sizeof(Header) || memcmp(h->magic, magic, 4) || h->version != version ||
+		!InMapping(sizeof(Header), (uint64_t) h->nEntries*sizeof(Entry))) {
+		printf("OpenTexturePack: %s is not a version %d pack\n", packFile, version);
+		Unmap();
+		return false;
+	}
+	const Entry *e = (const Entry *) (mapping+sizeof(Header));
+	for (uint32_t i = 0; i < h->nEntries; i++, e++) {
+		if (!ValidEntry(*e)) {
+			// truncated or corrupt: use none of it
+			printf("OpenTexturePack: %s is damaged\n", packFile);
+			CloseTexturePack();
+			return false;
+		}
+		entries[string((const char *) mapping+e->nameOffset, e->nameLength)] = e;
+	}
+	return true;
+}
+
+void CloseTexturePack() {
+	entries.clear();
+	Unmap();
+}
+
+bool TexturePackCurrent(vector<string> &imageFiles) {
+	for (string &f : imageFiles) {
+		int64_t size, time;
+		if (!SourceStat(f.c_str(), size, time))
+			continue;						// unreadable, so never packed
+		auto i = entries.find(f);
+		if (i == entries.end() || !Current(*i->second, f.c_str()) ||
+			(i->second->format && !BlockFormatSupported(i->second->format)))
+			return false;
+	}
+	return true;
+}
+
+bool FindPackedImage(const char *filename, PackedImage &image) {
+	auto i = entries.find(filename);
+	if (i == entries.end())
+		return false;
+	const Entry &e = *i->second;
+	if (!Current(e, filename))
+		return false;
+	if (e.format && !BlockFormatSupported(e.format))
+		return false;
+	image.width = e.width;
+	image.height = e.height;
+	image.nChannels = e.nChannels;
+	image.nStored = e.nStored;
+	image.nLevels = e.nLevels;
+	image.format = e.format;
+	image.pixels = mapping+e.pixelsOffset;
+	image.mask.width = e.maskWidth;
+	image.mask.height = e.maskHeight;
+	const unsigned int *bits = (const unsigned int *) (mapping+e.maskOffset);
+	image.mask.bits.assign(bits, bits+(e.maskWidth*e.maskHeight+31)/32);
+	return true;
+}
+
+GLuint LoadPackedTexture(const PackedImage &im, bool mipmap) {
+	// as LoadTexture, but each level comes from the pack
+	GLenum format = im.nStored == 1? GL_RED : GL_RGBA, internal = im.nStored == 1? GL_R8 : GL_RGBA8;
+	int nLevels = mipmap? im.nLevels : 1;
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	BindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	const unsigned char *p = im.pixels;
+	for (int l = 0; l < nLevels; l++) {
+		int w = LevelSize(im.width, l), h = LevelSize(im.height, l);
+		size_t size = LevelBytes(im.width, im.height, im.nStored, im.format, l);
+		if (im.format)
+			glCompressedTexImage2D(GL_TEXTURE_2D, l, im.format, w, h, 0, (GLsizei) size, p);
+		else
+			glTexImage2D(GL_TEXTURE_2D, l, internal, w, h, 0, format, GL_UNSIGNED_BYTE, p);
+		p += size;
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, nLevels-1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmap? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	BindTexture(GL_TEXTURE_2D, 0);
+	return texture;
+}
+
+GLuint LoadPackedTextureArray(vector<PackedImage> &frames) {
+	const PackedImage &f0 = frames[0];
+	GLenum format = f0.nStored == 1? GL_RED : GL_RGBA, internal = f0.nStored == 1? GL_R8 : GL_RGBA8;
+	GLuint array = 0;
+	glGenTextures(1, &array);
+	BindTexture(GL_TEXTURE_2D_ARRAY, array);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	size_t offset = 0;
+	for (int l = 0; l < f0.nLevels; l++) {
+		int w = LevelSize(f0.width, l), h = LevelSize(f0.height, l), n = (int) frames.size();
+		GLsizei size = (GLsizei) LevelBytes(f0.width, f0.height, f0.nStored, f0.format, l);
+		if (f0.format)
+			glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, l, f0.format, w, h, n, 0, n*size, NULL);
+		else
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, l, internal, w, h, n, 0, format, GL_UNSIGNED_BYTE, NULL);
+		for (int f = 0; f < n; f++) {
+			if (f0.format)
+				glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, 0, 0, f, w, h, 1, f0.format, size, frames[f].pixels+offset);
+			else
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, 0, 0, f, w, h, 1, format, GL_UNSIGNED_BYTE, frames[f].pixels+offset);
+		}
+		offset += size;
+	}
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, f0.nLevels-1);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	BindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	return array;
+}
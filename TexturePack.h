@@ -0,0 +1,53 @@
+// TexturePack.h - pre-decoded images, with mip chains and hit-test masks, in one mapped file
+
+#ifndef TEXTURE_PACK_HDR
+#define TEXTURE_PACK_HDR
+
+#include <glad.h>
+#include <string>
+#include <vector>
+#include "AlphaMask.h"
+
+using std::string;
+using std::vector;
+
+// a pack holds, for each image, its pixels as RGBA8 (or R8 if one channel) with
+// every mip level precomputed, and its hit-test mask; large images may instead be
+// stored block-compressed (see BlockCompress.h), 4-8x smaller; once a pack is open,
+// TextureCache and BuildAtlas take images from it rather than decode the files,
+// and textures are uploaded straight from the mapping, without glGenerateMipmap;
+// an entry is ignored if its image file has changed since packing
+
+bool WriteTexturePack(const char *packFile, vector<string> &imageFiles, int compressAbove = 0);
+	// decode the images into packFile; unreadable images are skipped; images with a
+	// side longer than compressAbove (if non-zero) are block-compressed, as supported
+	// by the current GL context: BC1 if opaque, else BC7 or BC3; any open pack is
+	// closed; packFile is replaced only once completely written
+
+bool OpenTexturePack(const char *packFile);
+	// map packFile (closing any open pack); false if missing, of another version,
+	// or with any entry out of the file's bounds
+
+bool TexturePackCurrent(vector<string> &imageFiles);
+	// true if the open pack has an entry for each readable image, none changed since
+	// packing nor in a format the current GL context can't use
+
+void CloseTexturePack();
+
+struct PackedImage {
+	int width = 0, height = 0;
+	int nChannels = 0;				// of the original image; stored as 4 unless 1
+	int nStored = 0, nLevels = 0;
+	GLenum format = 0;					// 0 if raw, else block-compressed
+	const unsigned char *pixels = NULL;	// level 0, then each smaller level, in the mapping
+	AlphaMask mask;
+};
+
+bool FindPackedImage(const char *filename, PackedImage &image);
+
+GLuint LoadPackedTexture(const PackedImage &image, bool mipmap = true);
+
+GLuint LoadPackedTextureArray(vector<PackedImage> &frames);
+	// frames must agree in size, #stored channels, #levels and format
+
+#endif
@@ -0,0 +1,68 @@
+// ThreadPool.cpp - persistent worker threads for data-parallel loops
+
+#include <algorithm>
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(int n) {
+	nThreads = n > 0? n : std::max(1, (int) std::thread::hardware_concurrency());
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (std::thread &t : workers)
+		t.join();
+}
+
+void ThreadPool::RunChunks() {
+	for (int begin; (begin = next.fetch_add(jobChunk)) < jobSize; )
+		(*job)(begin, std::min(begin+jobChunk, jobSize));
+}
+
+void ThreadPool::Work() {
+	unsigned int seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return quit || generation != seen; });
+			if (quit)
+				return;
+			seen = generation;
+		}
+		RunChunks();
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--nBusy == 0)
+			done.notify_one();
+	}
+}
+
+void ThreadPool::ParallelFor(int n, const std::function<void(int begin, int end)> &f, int chunk) {
+	if (n <= 0)
+		return;
+	chunk = std::max(1, chunk);
+	if (nThreads == 1 || n <= chunk) {
+		// not worth a wake
+		f(0, n);
+		return;
+	}
+	if (workers.empty())
+		for (int i = 1; i < nThreads; i++)
+			workers.emplace_back(&ThreadPool::Work, this);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &f;
+		jobSize = n;
+		jobChunk = chunk;
+		next = 0;
+		nBusy = (int) workers.size();
+		generation++;
+	}
+	wake.notify_all();
+	RunChunks();
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [&] { return nBusy == 0; });
+	job = NULL;
+}
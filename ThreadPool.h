@@ -0,0 +1,40 @@
+// ThreadPool.h - persistent worker threads for data-parallel loops
+
+#ifndef THREAD_POOL_HDR
+#define THREAD_POOL_HDR
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// workers start on first use and sleep between loops; the calling thread
+// works too, so a loop costs no thread creation, only a wake and a join
+
+class ThreadPool {
+public:
+	ThreadPool(int nThreads = 0);
+		// total threads, counting the caller; 0: hardware concurrency
+	~ThreadPool();
+	void ParallelFor(int n, const std::function<void(int begin, int end)> &f, int chunk = 256);
+		// call f over [0, n) in chunks, concurrently; return when all are done;
+		// f must not call ParallelFor
+	int NThreads() { return nThreads; }
+private:
+	int nThreads;
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	const std::function<void(int, int)> *job = NULL;
+	int jobSize = 0, jobChunk = 1;
+	std::atomic<int> next{0};
+	int nBusy = 0;
+	unsigned int generation = 0;
+	bool quit = false;
+	void Work();
+	void RunChunks();
+};
+
+#endif
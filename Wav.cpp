@@ -3,9 +3,13 @@
 
 #include <glad.h>
 #include "Draw.h"
+#include "DrawList.h"
+#include "GLState.h"
 #include "Text.h"
 #include "Wav.h"
 #include "Widgets.h"
+
+namespace { DrawList drawList; }
  
 // read
 
@@ -278,16 +282,16 @@ void WavView::ChangeView(int x, int y, int w, int h) {
 void WavView::Display() {
 	int4 vp = VPi();
 	vec3 grn(0,.7f,0), cyn(0,.7f,.7f), brn(.5f, 0, 0), prp(1, 0, .5f), blu(0, 0, 1);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glEnable(GL_LINE_SMOOTH);
+	Enable(GL_BLEND);
+	BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	Enable(GL_LINE_SMOOTH);
 	glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
-	glViewport(x, y, w, h);
+	SetViewport(x, y, w, h);
 	UseDrawShader(mat4());
 	if (w < nSamples)
 		for (int i = 0; i < w; i++) {
 			float t = (float) i/(w-1), xx = 2*t-1;
-			Line(vec2(xx, vmin[i]), vec2(xx, vmax[i]), 1, grn);
+			drawList.Line(vec2(xx, vmin[i]), vec2(xx, vmax[i]), 1, grn);
 		}
 	else
 		for (int i = 1; i < nSamples; i++) {
@@ -295,9 +299,10 @@ void WavView::Display() {
 			int k0 = channel == C_Mono? k1-1 : k1-2;
 			float x0 = (float)(i-1)/(nSamples-1), x1 = (float)i/(nSamples-1);
 			float v0 = (float)wav->samples[k0]/32767.f, v1 = (float)wav->samples[k1]/32767.f;
-			Line(vec2(2*x0-1, v0), vec2(2*x1-1, v1), 1, cyn);
+			drawList.Line(vec2(2*x0-1, v0), vec2(2*x1-1, v1), 1, cyn);
 		}
-	glViewport(vp[0], vp[1], vp[2], vp[3]);
+	drawList.Flush();				// one draw for the waveform
+	SetViewport(vp[0], vp[1], vp[2], vp[3]);
 	UseDrawShader(ScreenMode());
 	Quad(x, y, x, y+h, x+w, y+h, x+w, y, false, brn, 1, 2);
 	Line(x, y+h/2, x+w, y+h/2, 2, prp);
@@ -3,11 +3,15 @@
 
 #include <float.h>
 #include "Draw.h"
+#include "DrawList.h"
+#include "GLState.h"
 #include "GLXtras.h"
 #include "IO.h"
 #include "Text.h"
 #include "Widgets.h"
 
+namespace { DrawList drawList; }
+
 // Mouse
 
 vec2 NDCfromScreen(vec2 v) {
@@ -422,7 +426,7 @@ void Arcball::Draw(bool showConstrainAxes, mat4 *matOverride, vec3 *colorOverrid
 				vec3 q = v1+((float)i/23)*(v2-v1);
 				vec3 v = radius*normalize(q);
 				vec3 s2(center.x+v.x, center.y+v.y, 0);
-				if (i > 0) Line(s1, s2, lineWidth, color);
+				if (i > 0) drawList.Line(s1, s2, lineWidth, color);
 				s1 = s2;
 			}
 		// else should draw arc projected onto contraint.axis
@@ -430,9 +434,9 @@ void Arcball::Draw(bool showConstrainAxes, mat4 *matOverride, vec3 *colorOverrid
 			Constraint c = constraint.id == ConstraintIndex::None? GetConstraint((int) mouseMove.x, (int) mouseMove.y, matOverride) : constraint;
 			if (use == Use::Camera) {
 				if (!dragging || c.id == ConstraintIndex::YAxis)
-					Line(vec2(center.x-radius, center.y), vec2(center.x+radius, center.y), lineWidth, c.id == ConstraintIndex::YAxis? yellow : color);
+					drawList.Line(vec2(center.x-radius, center.y), vec2(center.x+radius, center.y), lineWidth, c.id == ConstraintIndex::YAxis? yellow : color);
 				if (!dragging || c.id == ConstraintIndex::XAxis)
-					Line(vec2(center.x, center.y-radius), vec2(center.x, center.y+radius), lineWidth, c.id == ConstraintIndex::XAxis? yellow : color);
+					drawList.Line(vec2(center.x, center.y-radius), vec2(center.x, center.y+radius), lineWidth, c.id == ConstraintIndex::XAxis? yellow : color);
 			}
 			if (use == Use::Body) {
 				for (int i = 0; i < 3; i++) {
@@ -446,7 +450,7 @@ void Arcball::Draw(bool showConstrainAxes, mat4 *matOverride, vec3 *colorOverrid
 						float t = (float) k / 19, a = t*2*3.1415f;
 						vec3 v = cos(a)*v1+sin(a)*v2;
 						p2 = center+radius*vec2(v.x, v.y);
-						if (k > 0) Line(p1, p2, lineWidth, col);
+						if (k > 0) drawList.Line(p1, p2, lineWidth, col);
 						p1 = p2;
 					}
 				}
@@ -457,9 +461,10 @@ void Arcball::Draw(bool showConstrainAxes, mat4 *matOverride, vec3 *colorOverrid
 		for (int i = 0; i < 36; i++) {
 			float ang = 2*3.141592f*((float)i/35);
 			vec3 p2(center.x+radius*cos(ang), center.y+radius*sin(ang), 0);
-			if (i > 0) Line(p1, p2, lineWidth, col);
+			if (i > 0) drawList.Line(p1, p2, lineWidth, col);
 			p1 = p2;
 		}
+		drawList.Flush();
 	}
 }
 
@@ -720,7 +725,7 @@ void Magnifier::Display(int2 displayLoc, bool showSrcWindow) {
 		void Rect(int xi, int yi, int wi, int hi, bool solid, vec3 col) {
 			float x = (float) xi, y = (float) yi, w = (float) wi, h = (float) hi;
 			vec3 p0(x, y, 0), p1(x+w, y, 0), p2(x+w, y+h, 0), p3(x, y+h, 0);
-			Quad(p0, p1, p2, p3, solid, col, 1, 4); // 2.5f);
+			drawList.Quad(p0, p1, p2, p3, solid, col, 1, 4); // 2.5f);
 		}
 	} h;
 	int nxBlocks = displaySize[0]/blockSize, nyBlocks = displaySize[1]/blockSize;
@@ -734,11 +739,13 @@ void Magnifier::Display(int2 displayLoc, bool showSrcWindow) {
 			vec3 col(pixel[0], pixel[1], pixel[2]);
 			h.Rect(displayLoc[0]+blockSize*i, displayLoc[1]+blockSize*j+dy, blockSize, blockSize, true, col);
 		}
-	bool blendOn = glIsEnabled(GL_BLEND);
-	glDisable(GL_BLEND);
+	drawList.Flush();
+	bool blendOn = IsEnabled(GL_BLEND);
+	Disable(GL_BLEND);
 	if (showSrcWindow)
 		h.Rect(srcLoc[0], srcLoc[1], nxBlocks-1, nyBlocks-1, false, cursorColor);
 	h.Rect(displayLoc[0], displayLoc[1]+dy, nxBlocks*blockSize, nyBlocks*blockSize, false, frameColor);
-	if (blendOn) glEnable(GL_BLEND);
+	drawList.Flush();
+	if (blendOn) Enable(GL_BLEND);
 	delete [] pixels;
 }